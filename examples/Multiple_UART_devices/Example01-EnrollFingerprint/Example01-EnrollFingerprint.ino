@@ -69,7 +69,7 @@ void loop()
 {
   // ID holds the memory address that the fingerprint will be saved to.
   // Valid ranges are 1 to 40, inclusive
-  byte ID = 1;
+  uint16_t ID = 1;
 
   Serial.print(F("Enrolling fingerprint in memory location "));
   Serial.println(ID);
@@ -68,7 +68,7 @@ void setup()
 void loop()
 {
   // Memory address location for fingerprint erasure
-  byte ID = 1;
+  uint16_t ID = 1;
 
   bool success = as108m.deleteFingerprintEntry(ID);
 
@@ -0,0 +1,348 @@
+/*
+  Identify fingerprints on two AS-108M/AD-013 readers at the same time
+  By: Ricardo Ramos
+  SparkFun Electronics
+  Date: June 14th, 2021
+  SparkFun code, firmware, and software is released under the MIT License. Please see LICENSE.md for further details.
+  Feel like supporting our work? Buy a board from SparkFun!
+  https://www.sparkfun.com/products/17151
+
+  This example shows how to run two readers side by side with AS108M_MANAGER. Each reader keeps identifying
+  every finger placed on it and a slow reader never holds up the other one.
+  
+  Note: This example will only work in devices with more than one hardware serial port like ESP32, STM32, Mega, etc.
+  
+  Hardware Connections:
+  - Connect the sensors to your board. Be aware that this sensor can be powered by 3.3V only!
+  - Open a serial monitor at 115200bps
+  
+  The example below illustrates how to use the AS-108M/AD-013 with an ESP32 ThingPlus board.
+  Readers sharing a single port are also supported: give each one its own address with setAddress()
+  and pass that address to begin().
+*/
+
+#include "SparkFun_AS108M_Arduino_Library.h"
+#include "SparkFun_AS108M_Manager.h"
+
+// Defines where the readers will be connected.
+// TX_PIN : Arduino --> Reader
+// RX_PIN : Arduino <-- Reader
+
+#define RX1_PIN   25        // First AD-013 blue wire
+#define TX1_PIN   26        // First AD-013 green wire
+#define RX2_PIN   16        // Second AD-013 blue wire
+#define TX2_PIN   17        // Second AD-013 green wire
+
+// Reader instances
+AS108M as108m;
+AS108M as108m2;
+
+// Manager that runs both readers
+AS108M_MANAGER manager;
+
+// Function prototypes for error callback functions
+void AS108_Callback();
+void AS108_Callback2();
+void printResponse(AS108M_RESPONSE_CODES response);
+
+// Function prototype for the function called when a reader identified a finger
+void Manager_Callback(byte index, AS108M_ASYNC_STATUS status);
+
+void setup()
+{
+  // Initialize monitor serial port
+  Serial.begin(115200);
+  Serial.println();
+  Serial.println(F("Starting up..."));
+
+  // Initialize reader serial ports
+  Serial1.begin(57600, SERIAL_8N2, RX1_PIN, TX1_PIN);
+  Serial2.begin(57600, SERIAL_8N2, RX2_PIN, TX2_PIN);
+
+  // Set built-in LED pin as output
+  pinMode(LED_BUILTIN, OUTPUT);
+
+  // the fingerprint scanner needs 100 ms after power up so let's wait and give it some slack also
+  delay(150);
+
+  // When calling begin we pass the reader serial port, the reader's address and an optional callback function as a parameter.
+  // The library will call this function if there are any errors during operation.
+  // The callback parameter is optional.
+  if (as108m.begin(Serial1, 0xffffffff, AS108_Callback) == true && as108m2.begin(Serial2, 0xffffffff, AS108_Callback2) == true)
+  {
+    Serial.println(F("AS108M readers are properly connected."));
+    digitalWrite(LED_BUILTIN, HIGH);
+  }
+  else
+  {
+    Serial.println(F("AS108M readers not properly connected - check your connections..."));
+    Serial.println(F("System halted!"));
+    while (true);
+  }
+
+  // Hand both readers to the manager and start identifying on each of them
+  manager.addReader(as108m);
+  manager.addReader(as108m2);
+  manager.setCallback(Manager_Callback);
+  manager.startIdentifyStreams();
+}
+
+// Time when the statistics were last printed
+unsigned long lastStats = 0;
+
+void loop()
+{
+  // Give every reader a turn - this never waits for the readers
+  manager.poll();
+
+  // Print how fast each reader answers every ten seconds
+  if (millis() - lastStats > 10000)
+  {
+    lastStats = millis();
+    for (byte i = 0; i < manager.getReaderCount(); i++)
+    {
+      AS108M_READER_STATS stats = manager.getStats(i);
+      Serial.print(F("Reader "));
+      Serial.print(i);
+      Serial.print(F(": "));
+      Serial.print(stats.completed);
+      Serial.print(F(" identified, "));
+      Serial.print(stats.failed);
+      Serial.print(F(" failed, average latency "));
+      Serial.print(stats.averageLatency);
+      Serial.println(F(" ms"));
+    }
+  }
+}
+
+// This function prints out which reader identified which fingerprint
+void Manager_Callback(byte index, AS108M_ASYNC_STATUS status)
+{
+  // The error callback function already told why an identification failed
+  if (status != AS108M_ASYNC_STATUS::COMPLETED)
+    return;
+
+  AS108M_QUERY_DATA sd = manager.getReader(index).getAsyncResult();
+
+  Serial.print(F("Reader "));
+  Serial.print(index);
+  Serial.print(F(": fingerprint matches ID "));
+  Serial.print(sd.pageId);
+  Serial.print(F(", match score "));
+  Serial.println(sd.matchScore);
+}
+
+// These functions print out the corresponding error message of each reader
+void AS108_Callback()
+{
+  Serial.print(F("Reader 0: "));
+  printResponse(as108m.response);
+}
+
+void AS108_Callback2()
+{
+  Serial.print(F("Reader 1: "));
+  printResponse(as108m2.response);
+}
+
+void printResponse(AS108M_RESPONSE_CODES response)
+{
+  switch (response)
+  {
+  case AS108M_RESPONSE_CODES::AS108M_OK:
+    // Just exit the switch
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR:
+    Serial.println(F("Packet receive error"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_NO_FINGER:
+    Serial.println(F("No fingertip on scanner"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_GET_FINGERPRINT_IMAGE_FAILED:
+    Serial.println(F("Get fingerprint image failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_DRY_TOO_LIGHT:
+    Serial.println(F("Fingerprint too dry or too light"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_HUMID_TOO_BLURRY:
+    Serial.println(F("Fingerprint too humid or too blurry"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_AMORPHOUS:
+    Serial.println(F("Fingerprint too amorphous"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_LITTLE_MINUTIAES:
+    Serial.println(F("Fingerprint too little minutiaes"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_UNMATCHED:
+    Serial.println(F("Fingerprint does not match ID"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_NO_FINGERPRINT_FOUND:
+    Serial.println(F("No matching fingerprint found in search"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_MERGING_FAILED:
+    Serial.println(F("Merging failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_ADDRESS_EXCEEDING_DATABASE_LIMIT:
+    Serial.println(F("Address exceeded device limit (40)"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_TEMPLATE_READING_ERROR_INVALID_TEMPLATE:
+    Serial.println(F("Template reading error or invalid template from database"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FEATURE_UPLOAD_FAILED:
+    Serial.println(F("Feature upload failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_CANNOT_RECEIVE_CONTINUOUS_PACKETS:
+    Serial.println(F("Module cannot receive continuous packets"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_IMAGE_UPLOADING_FAILED:
+    Serial.println(F("Image uploaded failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_IMAGE_DELETING_FAILED:
+    Serial.println(F("Image deleting failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_DATABASE_CLEAR_FAILED:
+    Serial.println(F("Fingerprint database clear failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_CANNOT_IN_LOW_POWER_CONSUMPTION:
+    Serial.println(F("Cannot perform task in low power mode"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_INVALID_PASSWORD:
+    Serial.println(F("Invalid password"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_SYSTEM_RESET_FAILED:
+    Serial.println(F("Device reset failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_NO_VALID_ORIGINAL_IMAGE_ON_BUFFER:
+    Serial.println(F("No image in buffer"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_ONLINE_UPGRADING_FAILED:
+    Serial.println(F("Upgrading failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_INCOMPLETE_OR_STILL_FINGERPRINT:
+    Serial.println(F("Incomplete fingerprint on sensor"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FLASH_READ_WRITE_ERROR:
+    Serial.println(F("Flash read/write error"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR:
+  case AS108M_RESPONSE_CODES::AS108M_UNDEFINED_ERROR:
+    Serial.println(F("Undefined/unknown error"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_INVALID_REGISTER:
+    Serial.println(F("Invalid register"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_REGISTER_DISTRIBUTING_CONTENT_WRONG_NUMBER:
+    Serial.println(F("Register content wrong number"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_NOTEPAD_PAGE_APPOINTING_ERROR:
+    Serial.println(F("Notepad appointing error"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_PORT_OPERATION_FAILED:
+    Serial.println(F("Port operation failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_AUTOMATIC_ENROLL_FAILED:
+    Serial.println(F("Automatic enroll failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_DATABASE_FULL:
+    Serial.println(F("Fingerprint database is full"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_MUST_VERIFY_PASSWORD:
+    Serial.println(F("Verify password"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_CONTINUE_PACKET_ACK_F0:
+    Serial.println(F("Existing instruction of continue data packet, ACK with 0xf0 after receiving correctly"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_CONTINUE_PACKET_ACK_F1:
+    Serial.println(F("Existing instruction of continue data packet, ACK with 0xf1 after receiving correctly"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_SUM_ERROR_BURNING_FLASH:
+    Serial.println(F("Checksum error burning flash"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_PACKET_FLAG_ERROR_BURNING_FLASH:
+    Serial.println(F("Packet flag error when burning flash"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_PACKET_LENGTH_ERROR_BURNING_FLASH:
+    Serial.println(F("Packet length error when burning flash"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_CODE_LENGTH_TOO_LONG_BURNING_FLASH:
+    Serial.println(F("Code length too long when burning flash"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_BURNING_FLASH_FAILED:
+    Serial.println(F("Burning flash failed"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_RESERVED:
+    Serial.println(F("Reserved"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_INVALID_RESPONSE:
+    Serial.println(F("Invalid response"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_BAD_CHECKSUM:
+    Serial.println(F("Wrong checksum"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_ADDRESS_MISMATCH:
+    Serial.println(F("Address mismatch"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT:
+    Serial.println(F("Receive timeout"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_TOUCH_SENSOR:
+    Serial.println(F("Please touch the scanner with your fingertip"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_REMOVE_FINGER:
+    Serial.println(F("Please remove your fingertip from the scanner"));
+    break;
+
+  case AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE:
+    Serial.println(F("No response"));
+    break;
+
+  default:
+    break;
+  }
+}
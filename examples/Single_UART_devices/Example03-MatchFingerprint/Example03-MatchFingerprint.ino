@@ -72,7 +72,7 @@ void setup()
 void loop()
 {
   // Memory address location for fingerprint match check
-  byte ID = 1;
+  uint16_t ID = 1;
 
   // Check if the fingerprint in the scanner matches the one stored in the device's memory at location ID
   AS108M_QUERY_DATA sd = as108m.getFingerprintMatch(ID);
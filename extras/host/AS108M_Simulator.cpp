@@ -0,0 +1,406 @@
+/*
+  Software AS108M for host builds, see AS108M_Simulator.h.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AS108M_Simulator.h"
+#include "SparkFun_AS108M_Constants.h"
+#include <algorithm>
+
+AS108M_SIMULATOR::AS108M_SIMULATOR()
+{
+	for (byte i = 0; i < 16; i++)
+		notepad[i].assign(32, 0);
+}
+
+std::vector<uint8_t> AS108M_SIMULATOR::fingerTemplate(int finger)
+{
+	std::vector<uint8_t> data(512);
+	for (int i = 0; i < 512; i++)
+		data[i] = static_cast<uint8_t>(finger * 31 + i * 7);
+	return data;
+}
+
+uint64_t AS108M_SIMULATOR::byteTime() const
+{
+	return 10000000ULL / baudrate;
+}
+
+void AS108M_SIMULATOR::queuePacket(byte flag, const std::vector<uint8_t>& payload, uint64_t delay)
+{
+	if (mute || hostBaudrate != baudrate)
+		return;
+
+	uint16_t length = payload.size() + 2;
+	std::vector<uint8_t> packet = { 0xef, 0x01, static_cast<uint8_t>(address >> 24), static_cast<uint8_t>(address >> 16),
+		static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address), flag, static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) };
+	uint16_t checkSum = flag + (length >> 8) + (length & 0xff);
+	for (uint8_t data : payload)
+	{
+		packet.push_back(data);
+		checkSum += data;
+	}
+	packet.push_back(checkSum >> 8);
+	packet.push_back(checkSum & 0xff);
+
+	// The module works on one command at a time
+	_txEnd = std::max(_txEnd, g_hostMicros) + delay;
+	queueBytes(packet);
+}
+
+void AS108M_SIMULATOR::queueBytes(const std::vector<uint8_t>& data)
+{
+	uint64_t time = std::max(_txEnd, g_hostMicros);
+	for (uint8_t value : data)
+	{
+		time += byteTime();
+		_tx.push_back(std::make_pair(time, value));
+	}
+	_txEnd = time;
+}
+
+void AS108M_SIMULATOR::reset()
+{
+	_tx.clear();
+	_txEnd = 0;
+	_rx.clear();
+	_downloading = false;
+}
+
+int AS108M_SIMULATOR::available()
+{
+	int count = 0;
+	for (const auto& pending : _tx)
+	{
+		if (pending.first > g_hostMicros)
+			break;
+		count++;
+	}
+	return count;
+}
+
+int AS108M_SIMULATOR::read()
+{
+	if (available() == 0)
+		return -1;
+
+	uint8_t data = _tx.front().second;
+	_tx.pop_front();
+	bytesSent++;
+	return data;
+}
+
+int AS108M_SIMULATOR::peek()
+{
+	return available() > 0 ? _tx.front().second : -1;
+}
+
+uint64_t AS108M_SIMULATOR::nextByteTime() const
+{
+	return _tx.empty() ? UINT64_MAX : _tx.front().first;
+}
+
+size_t AS108M_SIMULATOR::write(uint8_t data)
+{
+	bytesReceived++;
+	if (hostBaudrate != baudrate)
+		return 1;
+
+	// Hunt for the header, then collect the packet its length field announces
+	if (_rx.empty() && data != 0xef)
+		return 1;
+
+	_rx.push_back(data);
+	if (_rx.size() >= 9 && _rx.size() == 9U + ((_rx[7] << 8) | _rx[8]))
+	{
+		std::vector<uint8_t> packet;
+		packet.swap(_rx);
+		handlePacket(packet);
+	}
+	return 1;
+}
+
+void AS108M_SIMULATOR::ack(const std::vector<uint8_t>& payload, uint64_t delay)
+{
+	queuePacket(AS108M_FLAG_ACK, payload, (delay != 0 ? delay : processTime) + extraDelay);
+}
+
+void AS108M_SIMULATOR::sendData(const std::vector<uint8_t>& data)
+{
+	size_t packetSize = 32U << packetSizeCode;
+	for (size_t offset = 0; offset < data.size(); offset += packetSize)
+	{
+		size_t size = std::min(packetSize, data.size() - offset);
+		queuePacket(offset + size >= data.size() ? AS108M_FLAG_END : AS108M_FLAG_DATA,
+			std::vector<uint8_t>(data.begin() + offset, data.begin() + offset + size), 0);
+	}
+}
+
+void AS108M_SIMULATOR::handlePacket(const std::vector<uint8_t>& packet)
+{
+	byte flag = packet[6];
+	size_t length = (packet[7] << 8) | packet[8];
+	if (length < 2)
+		return;
+
+	std::vector<uint8_t> payload(packet.begin() + 9, packet.begin() + 9 + length - 2);
+	uint16_t checkSum = flag + packet[7] + packet[8];
+	for (uint8_t data : payload)
+		checkSum += data;
+	uint16_t receivedCheckSum = (packet[7 + length] << 8) | packet[8 + length];
+	uint32_t packetAddress = (static_cast<uint32_t>(packet[2]) << 24) | (packet[3] << 16) | (packet[4] << 8) | packet[5];
+	if (packetAddress != address)
+		return;
+
+	// Template data after DOWN_CHAR, a bad packet ends the download
+	if (flag == AS108M_FLAG_DATA || flag == AS108M_FLAG_END)
+	{
+		if (!_downloading)
+			return;
+
+		if (checkSum != receivedCheckSum)
+		{
+			_downloading = false;
+			return;
+		}
+
+		_download.insert(_download.end(), payload.begin(), payload.end());
+		if (flag == AS108M_FLAG_END)
+		{
+			charBuffer[_downloadBuffer] = _download;
+			_downloading = false;
+		}
+		return;
+	}
+
+	if (flag != AS108M_FLAG_COMMAND || payload.empty())
+		return;
+
+	if (checkSum != receivedCheckSum)
+	{
+		ack({ 0x01 });
+		return;
+	}
+
+	commands++;
+	instructions.push_back(payload[0]);
+	if (onCommand)
+		onCommand(payload[0]);
+	handleCommand(payload);
+}
+
+void AS108M_SIMULATOR::handleCommand(const std::vector<uint8_t>& p)
+{
+	switch (p[0])
+	{
+	case AS108M_CANCEL:
+		ack({ 0x00 });
+		break;
+
+	case AS108M_GET_IMAGE:
+		// The image buffer keeps the last finger read
+		if (finger < 0)
+			ack({ 0x02 }, 20000);
+		else
+		{
+			_imageFinger = finger;
+			ack({ 0x00 }, 20000);
+		}
+		break;
+
+	case AS108M_GET_CHAR:
+		if (_imageFinger < 0)
+			ack({ 0x15 });
+		else
+		{
+			charBuffer[p[1]] = fingerTemplate(_imageFinger);
+			ack({ 0x00 }, 30000);
+		}
+		break;
+
+	case AS108M_MATCH:
+		{
+			// Identical buffers score 200, anything else a low score derived from the template
+			bool same = !charBuffer[1].empty() && charBuffer[1] == charBuffer[2];
+			int score = same ? 200 : (charBuffer[2].empty() ? 0 : charBuffer[2][0] % 40);
+			ack({ static_cast<uint8_t>(same ? 0x00 : 0x08), static_cast<uint8_t>(score >> 8), static_cast<uint8_t>(score) }, 10000);
+		}
+		break;
+
+	case AS108M_SEARCH:
+		{
+			// Takes longer the further the match is
+			int start = (p[2] << 8) | p[3];
+			int count = (p[4] << 8) | p[5];
+			for (int page = start; page < start + count; page++)
+			{
+				auto entry = database.find(page);
+				if (entry != database.end() && entry->second == charBuffer[p[1]])
+				{
+					ack({ 0x00, static_cast<uint8_t>(page >> 8), static_cast<uint8_t>(page), 0x00, 150 }, 1000 + 500 * (page - start + 1));
+					return;
+				}
+			}
+			ack({ 0x09, 0x00, 0x00, 0x00, 0x00 }, 1000 + 500 * count);
+		}
+		break;
+
+	case AS108M_REG_MODEL:
+		{
+			// Merging works if every sample came from the same finger
+			bool same = !charBuffer[1].empty();
+			for (int i = 2; i <= 6; i++)
+				same &= charBuffer[i].empty() || charBuffer[i] == charBuffer[1];
+			if (same)
+				charBuffer[2] = charBuffer[1];
+			ack({ static_cast<uint8_t>(same ? 0x00 : 0x0a) }, 20000);
+		}
+		break;
+
+	case AS108M_STORE_CHAR:
+		{
+			int page = (p[2] << 8) | p[3];
+			if (page >= capacity)
+				ack({ 0x0b });
+			else
+			{
+				database[page] = charBuffer[p[1]];
+				ack({ 0x00 }, 40000);
+			}
+		}
+		break;
+
+	case AS108M_LOAD_CHAR:
+		{
+			int page = (p[2] << 8) | p[3];
+			auto entry = database.find(page);
+			if (page >= capacity)
+				ack({ 0x0b });
+			else if (entry == database.end())
+				ack({ 0x0c });
+			else
+			{
+				charBuffer[p[1]] = entry->second;
+				ack({ 0x00 }, 5000);
+			}
+		}
+		break;
+
+	case AS108M_UP_CHAR:
+		if (charBuffer[p[1]].empty())
+			ack({ 0x0d });
+		else
+		{
+			ack({ 0x00 });
+			sendData(charBuffer[p[1]]);
+		}
+		break;
+
+	case AS108M_DOWN_CHAR:
+		_downloading = true;
+		_downloadBuffer = p[1];
+		_download.clear();
+		ack({ 0x00 });
+		break;
+
+	case AS108M_UP_IMAGE:
+		if (_imageFinger < 0)
+			ack({ 0x0f });
+		else
+		{
+			ack({ 0x00 });
+			std::vector<uint8_t> image(imageSize);
+			for (int i = 0; i < imageSize; i++)
+				image[i] = static_cast<uint8_t>(i);
+			sendData(image);
+		}
+		break;
+
+	case AS108M_DELETE_CHAR:
+		{
+			int page = (p[1] << 8) | p[2];
+			int count = (p[3] << 8) | p[4];
+			for (int i = page; i < page + count; i++)
+				database.erase(i);
+			ack({ 0x00 }, 5000);
+		}
+		break;
+
+	case AS108M_EMPTY:
+		database.clear();
+		ack({ 0x00 }, 50000);
+		break;
+
+	case AS108M_WRITE_REG:
+		// The baudrate only changes on the next power cycle
+		if (p[1] == AS108M_BAUDRATE_CTRL_REG)
+			pendingBaudrate = p[2] * 9600UL;
+		else if (p[1] == AS108M_MATCH_THRES_REG)
+			threshold = p[2];
+		else if (p[1] == AS108M_PACKET_SIZE_REG)
+			packetSizeCode = p[2];
+		else
+		{
+			ack({ 0x1a });
+			break;
+		}
+		ack({ 0x00 });
+		break;
+
+	case AS108M_READ_SYS_PARAMETER:
+		{
+			uint16_t multiplier = baudrate / 9600;
+			ack({ 0x00, 0x00, 0x00, 0x00, 0x09, static_cast<uint8_t>(capacity >> 8), static_cast<uint8_t>(capacity), 0x00, threshold,
+				static_cast<uint8_t>(address >> 24), static_cast<uint8_t>(address >> 16), static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address),
+				0x00, packetSizeCode, static_cast<uint8_t>(multiplier >> 8), static_cast<uint8_t>(multiplier) });
+		}
+		break;
+
+	case AS108M_SET_CHIP_ADDRESS:
+		// The reply still carries the old address
+		ack({ 0x00 });
+		address = (static_cast<uint32_t>(p[1]) << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+		break;
+
+	case AS108M_WRITE_NOTEPAD:
+		notepad[p[1] & 0x0f].assign(p.begin() + 2, p.begin() + 34);
+		ack({ 0x00 });
+		break;
+
+	case AS108M_READ_NOTEPAD:
+		{
+			std::vector<uint8_t> reply = { 0x00 };
+			reply.insert(reply.end(), notepad[p[1] & 0x0f].begin(), notepad[p[1] & 0x0f].end());
+			ack(reply);
+		}
+		break;
+
+	case AS108M_VALID_TEMPLATE_NUM:
+		ack({ 0x00, static_cast<uint8_t>(database.size() >> 8), static_cast<uint8_t>(database.size()) });
+		break;
+
+	case AS108M_READ_INDEX_TABLE:
+		{
+			std::vector<uint8_t> reply(33, 0);
+			int base = p[1] * 256;
+			for (const auto& entry : database)
+			{
+				int page = entry.first - base;
+				if (page >= 0 && page < 256)
+					reply[1 + page / 8] |= 1 << (page % 8);
+			}
+			ack(reply);
+		}
+		break;
+
+	default:
+		ack({ 0x00 });
+		break;
+	}
+}
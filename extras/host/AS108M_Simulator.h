@@ -0,0 +1,108 @@
+/*
+  Software AS108M for host builds. It is the Stream a reader is started on: commands written to it are
+  answered like the module does, with each reply released byte by byte at the configured baudrate and only
+  after the command's processing time, one command after the other.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __AS108M_Simulator__
+#define __AS108M_Simulator__
+
+#include "Arduino.h"
+#include <deque>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+class AS108M_SIMULATOR : public Stream
+{
+public:
+	// Module settings, as READ_SYS_PARAMETER reports them
+	uint32_t address = 0xffffffff;
+	uint32_t baudrate = 57600;
+	uint32_t pendingBaudrate = 57600;
+	byte packetSizeCode = 2;
+	byte threshold = 3;
+	uint16_t capacity = 40;
+
+	// Baudrate the host port runs at, nothing gets through while it differs from baudrate
+	uint32_t hostBaudrate = 57600;
+
+	// Processing time in usec of commands without a time of their own
+	uint32_t processTime = 2000;
+
+	// Usec added to every reply, e.g. set from onCommand to make one command slow
+	uint32_t extraDelay = 0;
+
+	// Finger on the sensor, -1 for none. Templates are made from it by fingerTemplate()
+	int finger = -1;
+
+	// Template database, character buffers, notepad and the size of an uploaded image
+	std::map<int, std::vector<uint8_t> > database;
+	std::vector<uint8_t> charBuffer[7];
+	std::vector<uint8_t> notepad[16];
+	int imageSize = 160 * 160 / 2;
+
+	// While set, nothing is sent back
+	bool mute = false;
+
+	// Called with every valid command's instruction code before it is carried out, e.g. to move the finger
+	std::function<void(byte instruction)> onCommand;
+
+	// Commands carried out, their instruction codes in order and bytes moved each way
+	uint32_t commands = 0;
+	std::vector<byte> instructions;
+	uint32_t bytesReceived = 0;
+	uint32_t bytesSent = 0;
+
+	AS108M_SIMULATOR();
+
+	// The template a finger leaves in a character buffer
+	static std::vector<uint8_t> fingerTemplate(int finger);
+
+	// Usec one byte takes on the line
+	uint64_t byteTime() const;
+
+	// Sends a packet once the commands before it are done and delay usec have passed
+	void queuePacket(byte flag, const std::vector<uint8_t>& payload, uint64_t delay);
+
+	// Sends raw bytes right after whatever is being sent, e.g. line noise
+	void queueBytes(const std::vector<uint8_t>& data);
+
+	// Forgets half received commands and replies not sent yet, like a power cycle does
+	void reset();
+
+	int available();
+	int read();
+	int peek();
+	size_t write(uint8_t data);
+
+	// Time the next byte is released, for streams merging several modules
+	uint64_t nextByteTime() const;
+
+private:
+	// Bytes waiting to be sent with the time each is released
+	std::deque<std::pair<uint64_t, uint8_t> > _tx;
+	uint64_t _txEnd = 0;
+
+	// Command being received and data packets being downloaded
+	std::vector<uint8_t> _rx;
+	bool _downloading = false;
+	byte _downloadBuffer = 0;
+	std::vector<uint8_t> _download;
+	int _imageFinger = -1;
+
+	void ack(const std::vector<uint8_t>& payload, uint64_t delay = 0);
+	void sendData(const std::vector<uint8_t>& data);
+	void handlePacket(const std::vector<uint8_t>& packet);
+	void handleCommand(const std::vector<uint8_t>& parameters);
+};
+
+#endif
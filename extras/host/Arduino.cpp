@@ -0,0 +1,44 @@
+/*
+  Minimal Arduino core for building the library on a host computer, see Arduino.h.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Arduino.h"
+
+uint64_t g_hostMicros = 0;
+uint64_t g_hostSleepMicros = 0;
+int g_hostPinLevel = LOW;
+
+// Every clock read takes a few usec, so loops polling the clock always get somewhere
+unsigned long millis()
+{
+	g_hostMicros += 5;
+	return g_hostMicros / 1000;
+}
+
+unsigned long micros()
+{
+	g_hostMicros += 5;
+	return g_hostMicros;
+}
+
+void delay(unsigned long ms)
+{
+	g_hostMicros += ms * 1000ULL;
+	g_hostSleepMicros += ms * 1000ULL;
+}
+
+int digitalRead(uint8_t)
+{
+	return g_hostPinLevel;
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
@@ -0,0 +1,92 @@
+/*
+  Minimal Arduino core for building the library on a host computer.
+
+  Only what the library uses is provided. Time is virtual: it only moves forward when the code under test
+  reads the clock, waits with delay() or a test moves it on purpose, so runs are fast and repeatable.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __Host_Arduino__
+#define __Host_Arduino__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+
+#define LOW		0
+#define HIGH	1
+#define INPUT	0
+#define OUTPUT	1
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+int digitalRead(uint8_t pin);
+void pinMode(uint8_t pin, uint8_t mode);
+
+// Virtual time in usec, time spent in delay() and the level every digitalRead() returns
+extern uint64_t g_hostMicros;
+extern uint64_t g_hostSleepMicros;
+extern int g_hostPinLevel;
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t data) = 0;
+	virtual size_t write(const uint8_t* buffer, size_t size)
+	{
+		size_t written = 0;
+		while (size--)
+			written += write(*buffer++);
+		return written;
+	}
+	size_t write(const char* text) { return write(reinterpret_cast<const uint8_t*>(text), strlen(text)); }
+	virtual void flush() {}
+};
+
+class Stream : public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+
+	// Like Arduino's, gives up once nothing arrived for the timeout
+	void setTimeout(unsigned long timeout) { _timeout = timeout; }
+	size_t readBytes(uint8_t* buffer, size_t length)
+	{
+		size_t count = 0;
+		unsigned long start = millis();
+		while (count < length)
+		{
+			if (available() > 0)
+			{
+				buffer[count++] = static_cast<uint8_t>(read());
+				start = millis();
+			}
+			else if (millis() - start >= _timeout)
+				break;
+		}
+		return count;
+	}
+	size_t readBytes(char* buffer, size_t length) { return readBytes(reinterpret_cast<uint8_t*>(buffer), length); }
+
+protected:
+	unsigned long _timeout = 1000;
+};
+
+#endif
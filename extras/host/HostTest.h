@@ -0,0 +1,132 @@
+/*
+  Helpers shared by the host tests and the benchmark.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __Host_Test__
+#define __Host_Test__
+
+#include "Arduino.h"
+#include "AS108M_Simulator.h"
+#include "SparkFun_AS108M_Constants.h"
+#include <stdio.h>
+#include <vector>
+
+// Failed checks so far, main() returns it
+static int g_failures = 0;
+
+#define CHECK(condition) do { if (!(condition)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); g_failures++; } } while (0)
+
+// Prints the outcome of a test file and returns what main() should
+static inline int testResult(const char* name)
+{
+	printf("%s: %s\n", name, g_failures == 0 ? "passed" : "FAILED");
+	return g_failures == 0 ? 0 : 1;
+}
+
+// Msec of virtual time since start
+static inline double elapsedMs(uint64_t start)
+{
+	return (g_hostMicros - start) / 1000.0;
+}
+
+// A byte array to read from or write to
+class MemoryStream : public Stream
+{
+public:
+	std::vector<uint8_t> data;
+	size_t position = 0;
+
+	MemoryStream() {}
+	MemoryStream(const std::vector<uint8_t>& content) : data(content) {}
+
+	int available() { return data.size() - position; }
+	int read() { return position < data.size() ? data[position++] : -1; }
+	int peek() { return position < data.size() ? data[position] : -1; }
+	size_t write(uint8_t value) { data.push_back(value); return 1; }
+};
+
+// A host serial port wired to one or more simulated modules. What is written reaches every module, what they
+// send back is merged in the order it arrives. With txBufferSize set, writing blocks like a UART whose transmit
+// buffer is full, draining at the line rate.
+class HostPort : public Stream
+{
+public:
+	std::vector<AS108M_SIMULATOR*> modules;
+	uint16_t txBufferSize = 0;
+
+	HostPort() {}
+	HostPort(AS108M_SIMULATOR& module) { modules.push_back(&module); }
+
+	int available()
+	{
+		int count = 0;
+		for (AS108M_SIMULATOR* module : modules)
+			count += module->available();
+		return count;
+	}
+
+	int read()
+	{
+		AS108M_SIMULATOR* module = next();
+		return module != NULL ? module->read() : -1;
+	}
+
+	int peek()
+	{
+		AS108M_SIMULATOR* module = next();
+		return module != NULL ? module->peek() : -1;
+	}
+
+	size_t write(uint8_t value)
+	{
+		if (txBufferSize > 0)
+		{
+			uint64_t byteTime = modules[0]->byteTime();
+			_txEnd = (_txEnd > g_hostMicros ? _txEnd : g_hostMicros) + byteTime;
+			if (_txEnd > g_hostMicros + txBufferSize * byteTime)
+				g_hostMicros = _txEnd - txBufferSize * byteTime;
+		}
+
+		for (AS108M_SIMULATOR* module : modules)
+			module->write(value);
+		return 1;
+	}
+
+private:
+	uint64_t _txEnd = 0;
+
+	// The module whose next byte arrived first
+	AS108M_SIMULATOR* next()
+	{
+		AS108M_SIMULATOR* first = NULL;
+		for (AS108M_SIMULATOR* module : modules)
+		{
+			if (module->available() > 0 && (first == NULL || module->nextByteTime() < first->nextByteTime()))
+				first = module;
+		}
+		return first;
+	}
+};
+
+// Moves a finger on and off the sensor: every GET_IMAGE after the first onCount of a cycle finds no finger
+// for offCount GET_IMAGE, so enrolling sees the finger lifted between samples
+static inline void blinkFinger(AS108M_SIMULATOR& module, int finger, int onCount = 2, int offCount = 1)
+{
+	int images = 0;
+	AS108M_SIMULATOR* target = &module;
+	module.onCommand = [target, finger, onCount, offCount, images](byte instruction) mutable
+	{
+		if (instruction != AS108M_GET_IMAGE)
+			return;
+		target->finger = (images++ % (onCount + offCount)) < onCount ? finger : -1;
+	};
+}
+
+#endif
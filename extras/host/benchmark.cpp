@@ -0,0 +1,105 @@
+/*
+  Prints what the main calls cost against the simulated module at 57600 baud: virtual wall clock time, bytes on the
+  line both ways, time spent sleeping in delay() and commands sent. Built with AS108M_ENABLE_INSTRUMENTATION set,
+  so the per command latencies the library measured itself are printed too. Numbers only move when the library
+  or the simulator's timings do, which makes it easy to compare before and after a change.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+#include "SparkFun_AS108M_Manager.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+
+// What the module and the clock looked like when the measured call started
+struct Snapshot
+{
+	uint64_t micros;
+	uint64_t sleepMicros;
+	uint32_t bytes;
+	uint32_t commands;
+
+	Snapshot() : micros(g_hostMicros), sleepMicros(g_hostSleepMicros), bytes(module.bytesReceived + module.bytesSent), commands(module.commands) {}
+};
+
+static void report(const char* what, const Snapshot& start, int repeat = 1)
+{
+	printf("%-36s %9.1f ms %7.0f bytes %7.1f ms asleep %5.1f commands\n", what, (g_hostMicros - start.micros) / 1000.0 / repeat,
+		(double)(module.bytesReceived + module.bytesSent - start.bytes) / repeat, (g_hostSleepMicros - start.sleepMicros) / 1000.0 / repeat,
+		(double)(module.commands - start.commands) / repeat);
+}
+
+#define MEASURE(what, repeat, call) do { Snapshot start; for (int i = 0; i < (repeat); i++) { call; } report(what, start, repeat); } while (0)
+
+int main()
+{
+	reader.begin(port);
+	module.capacity = 200;
+	for (int i = 0; i < 100; i++)
+		module.database[i] = AS108M_SIMULATOR::fingerTemplate(i + 10);
+	module.finger = 60;
+	reader.readSystemParameters(true);
+	AS108M_INSTRUMENTATION instrumentation;
+	reader.setInstrumentation(&instrumentation);
+
+	printf("%-36s %12s %13s %16s %14s\n", "call", "time", "line", "delay()", "module");
+	MEASURE("isConnected()", 20, reader.isConnected());
+	MEASURE("getValidTemplateCount()", 20, reader.getValidTemplateCount());
+	MEASURE("readIndexTable()", 20, reader.readIndexTable(true));
+	MEASURE("captureImage()", 20, reader.captureImage());
+	MEASURE("searchFingerprint() page 50", 20, reader.searchFingerprint(0, 200));
+	MEASURE("getFingerprintMatch()", 20, reader.getFingerprintMatch(50));
+	const uint16_t candidates[] = { 10, 20, 30, 40, 50, 60 };
+	AS108M_QUERY_DATA results[3];
+	MEASURE("identifyFingerprint() 6 candidates", 20, reader.identifyFingerprint(candidates, 6, results, 3));
+	MEASURE("startSearch() until done", 20, reader.startSearch(0, 200); while (reader.poll() == AS108M_ASYNC_STATUS::BUSY) g_hostMicros += 100);
+
+	blinkFinger(module, 7);
+	MEASURE("enrollFingerprint() 2 samples", 5, reader.enrollFingerprint(150 + i, 2));
+	module.onCommand = nullptr;
+	module.finger = 60;
+
+	const uint16_t IDs[] = { 150, 151, 152, 153, 154 };
+	MEASURE("deleteFingerprintEntries() 5 IDs", 1, reader.deleteFingerprintEntries(IDs, 5));
+	MEASURE("deleteFingerprintEntry()", 5, reader.deleteFingerprintEntry(IDs[i]));
+
+	MemoryStream uploaded;
+	MEASURE("uploadTemplate()", 5, uploaded.data.clear(); reader.uploadTemplate(uploaded));
+	port.txBufferSize = 64;
+	MEASURE("downloadTemplate()", 5, MemoryStream source(uploaded.data); reader.downloadTemplate(source, source.data.size()));
+	port.txBufferSize = 0;
+	MemoryStream image;
+	MEASURE("uploadImage()", 1, reader.uploadImage(image));
+
+	module.mute = true;
+	MEASURE("getValidTemplateCount() no reply", 1, reader.getValidTemplateCount());
+	module.mute = false;
+
+	AS108M_MANAGER manager;
+	manager.addReader(reader);
+	port.txBufferSize = 64;
+	std::vector<uint8_t> data = AS108M_SIMULATOR::fingerTemplate(5);
+	MEASURE("deployTemplate() 1 reader", 5, manager.deployTemplate(data.data(), data.size(), 160 + i));
+
+	const struct
+	{
+		byte instruction;
+		const char* name;
+	} commands[] = { { AS108M_GET_IMAGE, "GET_IMAGE" }, { AS108M_GET_CHAR, "GET_CHAR" }, { AS108M_MATCH, "MATCH" },
+		{ AS108M_SEARCH, "SEARCH" }, { AS108M_REG_MODEL, "REG_MODEL" }, { AS108M_STORE_CHAR, "STORE_CHAR" },
+		{ AS108M_LOAD_CHAR, "LOAD_CHAR" }, { AS108M_UP_CHAR, "UP_CHAR" }, { AS108M_DOWN_CHAR, "DOWN_CHAR" },
+		{ AS108M_UP_IMAGE, "UP_IMAGE" }, { AS108M_DELETE_CHAR, "DELETE_CHAR" }, { AS108M_READ_SYS_PARAMETER, "READ_SYS_PARAMETER" },
+		{ AS108M_CANCEL, "other" } };
+	printf("\n%-20s %8s %8s %8s %8s %8s\n", "command", "count", "min ms", "mean ms", "max ms", "timeouts");
+	for (const auto& command : commands)
+	{
+		const AS108M_COMMAND_STATS& stats = reader.getCommandStats(command.instruction);
+		printf("%-20s %8lu %8lu %8lu %8lu %8lu\n", command.name, (unsigned long)stats.count, (unsigned long)stats.minLatency,
+			(unsigned long)stats.meanLatency, (unsigned long)stats.maxLatency, (unsigned long)stats.timeouts);
+	}
+	printf("\n%lu bytes sent, %lu received, %lu timeouts, %lu ms asleep\n", (unsigned long)instrumentation.bytesSent,
+		(unsigned long)instrumentation.bytesReceived, (unsigned long)instrumentation.timeouts, (unsigned long)instrumentation.sleepTime);
+	return 0;
+}
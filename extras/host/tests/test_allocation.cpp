@@ -0,0 +1,124 @@
+/*
+  The library must never touch the heap: every public call is made with operator new counting, and only the
+  simulated module behind the port is allowed to allocate.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+#include "SparkFun_AS108M_Manager.h"
+#include <new>
+#include <stdlib.h>
+
+// Allocations made while armed and outside the simulator
+static bool g_armed = false;
+static int g_simulatorDepth = 0;
+static long g_allocations = 0;
+
+static void* allocate(size_t size)
+{
+	if (g_armed && g_simulatorDepth == 0)
+		g_allocations++;
+	void* memory = malloc(size != 0 ? size : 1);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+
+// Marks everything the port does as the simulator's
+class GuardedPort : public Stream
+{
+public:
+	HostPort& port;
+
+	GuardedPort(HostPort& wrapped) : port(wrapped) {}
+
+	int available() { g_simulatorDepth++; int result = port.available(); g_simulatorDepth--; return result; }
+	int read() { g_simulatorDepth++; int result = port.read(); g_simulatorDepth--; return result; }
+	int peek() { g_simulatorDepth++; int result = port.peek(); g_simulatorDepth--; return result; }
+	size_t write(uint8_t value) { g_simulatorDepth++; size_t result = port.write(value); g_simulatorDepth--; return result; }
+};
+
+// A sink and a source that do not allocate either
+class FixedStream : public Stream
+{
+public:
+	byte data[600];
+	uint16_t size = 0;
+	uint16_t position = 0;
+
+	int available() { return size - position; }
+	int read() { return position < size ? data[position++] : -1; }
+	int peek() { return position < size ? data[position] : -1; }
+	size_t write(uint8_t value) { if (size < sizeof(data)) data[size++] = value; return 1; }
+};
+
+static AS108M_SIMULATOR module;
+static HostPort hostPort(module);
+static GuardedPort port(hostPort);
+static AS108M reader;
+
+// Runs call with allocations counted and fails the test if there were any
+#define NO_ALLOCATION(call) do { g_allocations = 0; g_armed = true; call; g_armed = false; \
+	if (g_allocations != 0) { printf("FAIL %s:%d: %ld allocations in %s\n", __FILE__, __LINE__, g_allocations, #call); g_failures++; } } while (0)
+
+int main()
+{
+	NO_ALLOCATION(CHECK(reader.begin(port)));
+	module.database[7] = AS108M_SIMULATOR::fingerTemplate(3);
+	module.finger = 3;
+
+	NO_ALLOCATION(CHECK(reader.isConnected()));
+	NO_ALLOCATION(reader.readSystemParameters(true));
+	NO_ALLOCATION(CHECK(reader.readIndexTable(true)));
+	NO_ALLOCATION(CHECK(reader.searchFingerprint().pageId == 7));
+	NO_ALLOCATION(CHECK(reader.getFingerprintMatch(7).found));
+	const uint16_t candidates[] = { 5, 7, 9 };
+	AS108M_QUERY_DATA results[2];
+	NO_ALLOCATION(CHECK(reader.identifyFingerprint(candidates, 3, results, 2) == 1));
+	NO_ALLOCATION(reader.getValidTemplateCount());
+
+	blinkFinger(module, 5);
+	NO_ALLOCATION(CHECK(reader.enrollFingerprint(12, 2)));
+	module.onCommand = nullptr;
+	module.finger = 3;
+	const uint16_t IDs[] = { 12, 13 };
+	NO_ALLOCATION(CHECK(reader.deleteFingerprintEntries(IDs, 2)));
+
+	FixedStream sink;
+	NO_ALLOCATION(CHECK(reader.captureImage()));
+	NO_ALLOCATION(CHECK(reader.uploadTemplate(sink, AS108M_BUFFER_ID_1)));
+	NO_ALLOCATION(CHECK(reader.downloadTemplate(sink, sink.size, AS108M_BUFFER_ID_2)));
+
+	// Lost replies, retries and line noise
+	module.mute = true;
+	NO_ALLOCATION(reader.getValidTemplateCount());
+	module.mute = false;
+	module.queueBytes({ 0xef, 0x01, 0x02, 0xef, 0x33 });
+	NO_ALLOCATION(reader.isConnected());
+
+	// Operations without blocking, alone and through a manager
+	NO_ALLOCATION(CHECK(reader.startSearch()));
+	NO_ALLOCATION(while (reader.poll() == AS108M_ASYNC_STATUS::BUSY) delay(1));
+	CHECK(reader.getAsyncResult().pageId == 7);
+
+	AS108M_MANAGER manager;
+	NO_ALLOCATION(CHECK(manager.addReader(reader)));
+	NO_ALLOCATION(CHECK(manager.startIdentifyStreams()));
+	NO_ALLOCATION(for (int i = 0; i < 5000; i++) { manager.poll(); g_hostMicros += 200; });
+	module.finger = -1;
+	NO_ALLOCATION(manager.stopIdentifyStreams());
+	NO_ALLOCATION(while (manager.poll()) delay(1));
+	CHECK(manager.getStats(0).completed > 0);
+
+	std::vector<uint8_t> data = AS108M_SIMULATOR::fingerTemplate(6);
+	NO_ALLOCATION(CHECK(manager.deployTemplate(data.data(), data.size(), 20) == 1));
+
+	return testResult("test_allocation");
+}
@@ -0,0 +1,184 @@
+/*
+  Non-blocking search, match and enroll driven by poll(), identify streams and finger polling back-off.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+static int completions = 0;
+
+static void countCompletion()
+{
+	completions++;
+}
+
+// Polls until the operation ends, the loop around it taking 100 usec
+static AS108M_ASYNC_STATUS finish()
+{
+	AS108M_ASYNC_STATUS status;
+	int polls = 0;
+	while ((status = reader.poll()) == AS108M_ASYNC_STATUS::BUSY && polls < 1000000)
+	{
+		polls++;
+		g_hostMicros += 100;
+	}
+	return status;
+}
+
+static void testOperations()
+{
+	reader.setAsyncCallback(countCompletion);
+	module.finger = 3;
+	module.database[9] = AS108M_SIMULATOR::fingerTemplate(3);
+
+	CHECK(reader.startSearch());
+	CHECK(!reader.startSearch());
+	CHECK(finish() == AS108M_ASYNC_STATUS::COMPLETED);
+	CHECK(reader.getAsyncResult().found && reader.getAsyncResult().pageId == 9);
+
+	CHECK(reader.startMatch(9));
+	CHECK(finish() == AS108M_ASYNC_STATUS::COMPLETED);
+	CHECK(reader.getAsyncResult().matchScore == 200);
+
+	CHECK(reader.startMatch(8));
+	CHECK(finish() == AS108M_ASYNC_STATUS::FAILED);
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_TEMPLATE_READING_ERROR_INVALID_TEMPLATE);
+
+	module.finger = -1;
+	CHECK(reader.startSearch());
+	CHECK(finish() == AS108M_ASYNC_STATUS::FAILED);
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+
+	blinkFinger(module, 4);
+	CHECK(reader.startEnroll(12, 3));
+	CHECK(finish() == AS108M_ASYNC_STATUS::COMPLETED);
+	CHECK(module.database.count(12) == 1);
+	CHECK(completions == 5);
+	module.onCommand = nullptr;
+
+	module.mute = true;
+	CHECK(reader.startSearch());
+	CHECK(finish() == AS108M_ASYNC_STATUS::FAILED);
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT);
+	module.mute = false;
+	reader.setAsyncCallback(NULL);
+}
+
+static void testIdentifyStream()
+{
+	module.database.clear();
+	module.database[4] = AS108M_SIMULATOR::fingerTemplate(1);
+	module.database[6] = AS108M_SIMULATOR::fingerTemplate(2);
+
+	// By GET_IMAGE count: nothing, finger 1, nothing with the odd unknown finger, finger 2...
+	int images = 0;
+	module.onCommand = [&images](byte instruction)
+	{
+		if (instruction != AS108M_GET_IMAGE)
+			return;
+		images++;
+		int phase = (images / 5) % 4;
+		module.finger = phase == 1 ? 1 : phase == 3 ? 2 : (phase == 2 && images % 7 == 0) ? 9 : -1;
+	};
+
+	CHECK(reader.startIdentifyStream());
+	int found = 0;
+	int failed = 0;
+	uint64_t start = g_hostMicros;
+	while (g_hostMicros - start < 3000000)
+	{
+		AS108M_ASYNC_STATUS status = reader.poll();
+		if (status == AS108M_ASYNC_STATUS::COMPLETED)
+		{
+			found++;
+			CHECK(reader.getAsyncResult().pageId == 4 || reader.getAsyncResult().pageId == 6);
+		}
+		else if (status == AS108M_ASYNC_STATUS::FAILED)
+			failed++;
+		g_hostMicros += 200;
+	}
+	printf("  identify stream: %d found, %d failed in 3 s\n", found, failed);
+	CHECK(found > 3);
+
+	reader.stopIdentifyStream();
+	CHECK(finish() != AS108M_ASYNC_STATUS::BUSY);
+	module.onCommand = nullptr;
+}
+
+// Finger lands 300 ms after the touch prompt and leaves 300 ms after the remove prompt
+static uint64_t touchPrompt = 0;
+static uint64_t removePrompt = 0;
+static bool touchWanted = false;
+
+static void updateFinger()
+{
+	if (touchWanted)
+		module.finger = (g_hostMicros - touchPrompt > 300000) ? 5 : -1;
+	else
+		module.finger = (g_hostMicros - removePrompt > 300000) ? -1 : 5;
+	g_hostPinLevel = module.finger >= 0;
+}
+
+static void prompt()
+{
+	if (reader.response == AS108M_RESPONSE_CODES::AS108M_TOUCH_SENSOR)
+	{
+		touchPrompt = g_hostMicros;
+		touchWanted = true;
+	}
+	else if (reader.response == AS108M_RESPONSE_CODES::AS108M_REMOVE_FINGER)
+	{
+		removePrompt = g_hostMicros;
+		touchWanted = false;
+	}
+}
+
+static bool touched()
+{
+	updateFinger();
+	return g_hostPinLevel;
+}
+
+static void testFingerPolling()
+{
+	// A user takes 600 ms per sample, what is on top of that is polling overhead
+	module.database.clear();
+	CHECK(reader.begin(port, 0xffffffff, prompt));
+	module.onCommand = [](byte) { updateFinger(); };
+
+	uint64_t start = g_hostMicros;
+	uint32_t commands = module.commands;
+	CHECK(reader.enrollFingerprint(3, 5));
+	printf("  blocking enroll: %.0f ms over the user time per sample, %u commands\n", elapsedMs(start) / 5 - 600, module.commands - commands);
+	CHECK(elapsedMs(start) / 5 - 600 < 300);
+
+	reader.setTouchCallback(touched);
+	start = g_hostMicros;
+	commands = module.commands;
+	CHECK(reader.enrollFingerprint(4, 5));
+	printf("  with touch-out line: %.0f ms over, %u commands\n", elapsedMs(start) / 5 - 600, module.commands - commands);
+	CHECK(elapsedMs(start) / 5 - 600 < 500 && module.commands - commands < 20);
+	reader.setTouchCallback(NULL);
+
+	start = g_hostMicros;
+	CHECK(reader.startEnroll(6, 5));
+	while (reader.poll() == AS108M_ASYNC_STATUS::BUSY)
+		g_hostMicros += 500;
+	CHECK(reader.getAsyncStatus() == AS108M_ASYNC_STATUS::COMPLETED);
+	printf("  non-blocking enroll: %.0f ms over\n", elapsedMs(start) / 5 - 600);
+	CHECK(elapsedMs(start) / 5 - 600 < 300);
+	CHECK(module.database.count(3) && module.database.count(4) && module.database.count(6));
+	module.onCommand = nullptr;
+}
+
+int main()
+{
+	CHECK(reader.begin(port));
+	testOperations();
+	testIdentifyStream();
+	testFingerPolling();
+	return testResult("test_async");
+}
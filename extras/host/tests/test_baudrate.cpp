@@ -0,0 +1,90 @@
+/*
+  Finding the baudrate a reader runs at and moving it to the fastest one that works.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+
+// Baudrate the module fails at, 0 for none
+static uint32_t brokenBaudrate = 0;
+static int powerCycles = 0;
+
+static int countInstructions(byte instruction)
+{
+	int count = 0;
+	for (byte sent : module.instructions)
+		count += sent == instruction;
+	return count;
+}
+
+static void setHostBaudrate(uint32_t baudrate)
+{
+	module.hostBaudrate = baudrate;
+	module.reset();
+}
+
+static void powerCycle()
+{
+	powerCycles++;
+	module.baudrate = module.pendingBaudrate;
+	module.reset();
+}
+
+int main()
+{
+	module.baudrate = module.pendingBaudrate = 19200;
+	module.onCommand = [](byte instruction)
+	{
+		module.mute = instruction == AS108M_READ_SYS_PARAMETER && module.baudrate == brokenBaudrate;
+	};
+	reader.begin(port);
+
+	uint64_t start = g_hostMicros;
+	CHECK(reader.detectBaudrate(setHostBaudrate) == 19200);
+	printf("  detected in %.1f ms\n", elapsedMs(start));
+
+	// Only the three faster baudrates tried first may run into their probe timeout
+	CHECK(elapsedMs(start) < 4 * AS108M_BAUDRATE_PROBE_TIMEOUT);
+
+	start = g_hostMicros;
+	CHECK(reader.negotiateBaudrate(setHostBaudrate, powerCycle));
+	printf("  negotiated in %.1f ms with %d power cycles\n", elapsedMs(start), powerCycles);
+	CHECK(elapsedMs(start) < 4 * AS108M_BAUDRATE_PROBE_TIMEOUT + AS108M_POWER_UP_DELAY);
+	CHECK(module.baudrate == 115200 && module.hostBaudrate == 115200 && reader.getBaudrate() == 115200);
+
+	// Already at the fastest baudrate, nothing to cycle
+	powerCycles = 0;
+	CHECK(reader.negotiateBaudrate(setHostBaudrate, powerCycle));
+	CHECK(powerCycles == 0 && module.pendingBaudrate == 115200);
+
+	// 115200 does not work on this module, it falls back to the next one down
+	module.baudrate = module.pendingBaudrate = 9600;
+	module.mute = false;
+	brokenBaudrate = 115200;
+	powerCycles = 0;
+	CHECK(reader.negotiateBaudrate(setHostBaudrate, powerCycle));
+	CHECK(module.hostBaudrate == 57600 && module.baudrate == 57600 && module.pendingBaudrate == 57600);
+
+	// Without a way to power cycle the reader is only found, its baudrate register is left alone
+	brokenBaudrate = 0;
+	module.baudrate = module.pendingBaudrate = 38400;
+	module.instructions.clear();
+	CHECK(!reader.negotiateBaudrate(setHostBaudrate));
+	CHECK(module.hostBaudrate == 38400 && module.pendingBaudrate == 38400);
+	CHECK(countInstructions(AS108M_WRITE_REG) == 0);
+	CHECK(reader.negotiateBaudrate(setHostBaudrate, NULL, AS108M_BAUDRATE::AS108M_38400));
+	CHECK(countInstructions(AS108M_WRITE_REG) == 0);
+
+	// Nothing answers
+	module.onCommand = nullptr;
+	module.mute = true;
+	CHECK(!reader.negotiateBaudrate(setHostBaudrate, powerCycle));
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE);
+	CHECK(reader.detectBaudrate(setHostBaudrate) == 0);
+
+	return testResult("test_baudrate");
+}
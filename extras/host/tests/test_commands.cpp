@@ -0,0 +1,111 @@
+/*
+  Blocking commands against the simulated module: every reply is handed over the moment its last byte arrives,
+  and the system parameters are only read once.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+
+static void testLatencyBoundedByWireTime()
+{
+	// Command and reply cross the line once, plus the module's processing time: no sleeping anywhere
+	uint64_t start = g_hostMicros;
+	uint64_t sleepStart = g_hostSleepMicros;
+	CHECK(reader.getValidTemplateCount() == 0);
+	uint64_t wireTime = (12 + 14) * module.byteTime();
+	uint64_t latency = g_hostMicros - start;
+	printf("  VALID_TEMPLATE_NUM: %.2f ms, processing %.2f ms and wire time %.2f ms\n", latency / 1000.0, module.processTime / 1000.0, wireTime / 1000.0);
+	CHECK(latency <= module.processTime + wireTime + 1000);
+	CHECK(g_hostSleepMicros == sleepStart);
+
+	// Identify is three commands, the old fixed 50 ms sleep per reply alone would be 150 ms
+	module.database[7] = AS108M_SIMULATOR::fingerTemplate(3);
+	module.finger = 3;
+	start = g_hostMicros;
+	AS108M_QUERY_DATA result = reader.searchFingerprint();
+	printf("  searchFingerprint(): %.2f ms\n", elapsedMs(start));
+	CHECK(result.found && result.pageId == 7 && result.matchScore == 150);
+	CHECK(elapsedMs(start) < 20 + 30 + 5 + 10);
+	CHECK(g_hostSleepMicros == sleepStart);
+}
+
+static void testSearchAndMatch()
+{
+	module.database.clear();
+	module.database[5] = AS108M_SIMULATOR::fingerTemplate(3);
+	module.finger = 3;
+
+	AS108M_QUERY_DATA result = reader.searchFingerprint(8, 10);
+	CHECK(!result.found && reader.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGERPRINT_FOUND);
+	result = reader.searchFingerprint(5, AS108M_SEARCH_AUTO);
+	CHECK(result.found && result.pageId == 5);
+	result = reader.searchFingerprint(40, AS108M_SEARCH_AUTO);
+	CHECK(!result.found && reader.response == AS108M_RESPONSE_CODES::AS108M_ADDRESS_EXCEEDING_DATABASE_LIMIT);
+
+	result = reader.getFingerprintMatch(5);
+	CHECK(result.found && result.matchScore == 200);
+	result = reader.getFingerprintMatch(8);
+	CHECK(!result.found);
+
+	module.finger = -1;
+	result = reader.searchFingerprint();
+	CHECK(!result.found && reader.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+}
+
+static void testEnrollAndDelete()
+{
+	module.database.clear();
+	blinkFinger(module, 4);
+	CHECK(reader.enrollFingerprint(6, 2));
+	CHECK(module.database.count(6) == 1 && module.database[6] == AS108M_SIMULATOR::fingerTemplate(4));
+	module.onCommand = nullptr;
+
+	CHECK(reader.deleteFingerprintEntry(6));
+	CHECK(module.database.count(6) == 0);
+	module.database[1] = AS108M_SIMULATOR::fingerTemplate(1);
+	CHECK(reader.clearFingerprintDatabase());
+	CHECK(module.database.empty());
+}
+
+static void testSystemParameters()
+{
+	CHECK(reader.getDatabaseSize() == 40);
+	CHECK(reader.getMatchThreshold() == 3);
+	CHECK(reader.getBaudrate() == 57600);
+	CHECK(reader.getAddress() == 0xffffffff);
+
+	// Every getter is served from one READ_SYS_PARAMETER
+	uint32_t commands = module.commands;
+	reader.getDatabaseSize();
+	reader.getAddress();
+	reader.getBaudrate();
+	reader.getMatchThreshold();
+	reader.readSystemParameters();
+	CHECK(module.commands == commands);
+
+	// Writing a register refreshes the cache
+	CHECK(reader.setMatchThreshold(4));
+	CHECK(reader.getMatchThreshold() == 4);
+	CHECK(reader.readSystemParameters().databaseSize == 40);
+}
+
+int main()
+{
+	CHECK(reader.begin(port));
+	testLatencyBoundedByWireTime();
+	testSearchAndMatch();
+	testEnrollAndDelete();
+	testSystemParameters();
+
+	// Built without instrumentation nothing is collected, even with somewhere to collect into
+	AS108M_INSTRUMENTATION instrumentation;
+	reader.setInstrumentation(&instrumentation);
+	CHECK(reader.isConnected());
+	CHECK(instrumentation.bytesSent == 0 && reader.getCommandStats(AS108M_CANCEL).count == 0);
+	reader.setInstrumentation(NULL);
+	return testResult("test_commands");
+}
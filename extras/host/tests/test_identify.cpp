@@ -0,0 +1,59 @@
+/*
+  Ranking a candidate list against one capture.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+static int failures = 0;
+
+int main()
+{
+	CHECK(reader.begin(port, 0xffffffff, [] { failures++; }));
+	for (int i = 1; i <= 6; i++)
+		module.database[i * 3] = AS108M_SIMULATOR::fingerTemplate(i);
+	module.finger = 4;
+
+	// Page 20 is empty and skipped
+	const uint16_t candidates[] = { 3, 6, 9, 12, 15, 18, 20 };
+	AS108M_QUERY_DATA results[3];
+	uint64_t start = g_hostMicros;
+	uint32_t commands = module.commands;
+	byte count = reader.identifyFingerprint(candidates, 7, results, 3);
+	printf("  best 3 of 7 candidates in %.1f ms, %lu commands:", elapsedMs(start), (unsigned long)(module.commands - commands));
+	for (byte i = 0; i < count; i++)
+		printf(" %u:%u%s", results[i].pageId, results[i].matchScore, results[i].found ? "*" : "");
+	printf("\n");
+	CHECK(count == 3 && results[0].found && results[0].pageId == 12 && results[0].matchScore == 200);
+	CHECK(!results[1].found && results[1].matchScore >= results[2].matchScore);
+	CHECK(failures == 0);
+
+	// Known empty pages are not even loaded
+	CHECK(reader.readIndexTable(true));
+	commands = module.commands;
+	count = reader.identifyFingerprint(candidates, 7, results, 3);
+	CHECK(count == 3 && results[0].pageId == 12 && failures == 0);
+	CHECK(module.commands - commands == 2 + 2 * 6);
+
+	start = g_hostMicros;
+	commands = module.commands;
+	for (int i = 0; i < 6; i++)
+		reader.getFingerprintMatch(candidates[i]);
+	printf("  6 getFingerprintMatch() in %.1f ms, %lu commands\n", elapsedMs(start), (unsigned long)(module.commands - commands));
+
+	failures = 0;
+	AS108M_QUERY_DATA all[10];
+	CHECK(reader.identifyFingerprint(candidates, 7, all, 10) == 6);
+	for (int i = 1; i < 6; i++)
+		CHECK(all[i - 1].matchScore >= all[i].matchScore);
+	CHECK(reader.identifyFingerprint(candidates, 7, all, 0) == 0 && reader.response == AS108M_RESPONSE_CODES::AS108M_OK);
+	CHECK(failures == 0);
+
+	module.finger = -1;
+	CHECK(reader.identifyFingerprint(candidates, 7, results, 3) == 0 && failures == 1);
+
+	return testResult("test_identify");
+}
@@ -0,0 +1,172 @@
+/*
+  Template occupancy cached from READ_INDEX_TABLE, deleting ranges and ID lists, and page IDs past 255.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+
+static int countInstructions(byte instruction)
+{
+	int count = 0;
+	for (byte sent : module.instructions)
+		count += sent == instruction;
+	return count;
+}
+
+static void testOccupancy()
+{
+	for (int i = 0; i < 17; i++)
+		module.database[i] = AS108M_SIMULATOR::fingerTemplate(100 + i);
+	module.database[20] = AS108M_SIMULATOR::fingerTemplate(3);
+
+	// One index table and one system parameter read answer all of these
+	uint32_t commands = module.commands;
+	CHECK(reader.isSlotUsed(20));
+	CHECK(!reader.isSlotUsed(19));
+	CHECK(reader.enrolledCount() == 18);
+	CHECK(reader.findFreeSlot() == 17);
+	CHECK(reader.findFreeSlot(20) == 21);
+	CHECK(module.commands - commands == 2);
+	CHECK(reader.getValidTemplateCount() == 18);
+
+	CHECK(reader.deleteFingerprintEntry(3));
+	CHECK(!reader.isSlotUsed(3));
+	CHECK(reader.enrolledCount() == 17);
+	CHECK(reader.findFreeSlot() == 3);
+
+	// The search stops after the last enrolled page
+	module.finger = 3;
+	commands = module.commands;
+	AS108M_QUERY_DATA result = reader.searchFingerprint(0, AS108M_SEARCH_AUTO);
+	CHECK(result.found && result.pageId == 20);
+	CHECK(module.commands - commands == 3);
+
+	CHECK(reader.clearFingerprintDatabase());
+	CHECK(reader.enrolledCount() == 0);
+	reader.searchFingerprint(0, AS108M_SEARCH_AUTO);
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGERPRINT_FOUND);
+
+	for (int i = 0; i < 40; i++)
+		module.database[i] = AS108M_SIMULATOR::fingerTemplate(i);
+	CHECK(reader.readIndexTable(true));
+	CHECK(reader.findFreeSlot() == -1);
+	CHECK(reader.enrolledCount() == 40);
+}
+
+static void testDeleteLists()
+{
+	// Pages 4, 9, 14... are empty
+	module.database.clear();
+	for (int i = 0; i < 40; i++)
+	{
+		if (i % 5 != 4)
+			module.database[i] = AS108M_SIMULATOR::fingerTemplate(i);
+	}
+
+	// Without the index table only neighbouring IDs are joined
+	CHECK(reader.readIndexTable(true));
+	reader.readIndexTable(false);
+	AS108M cold;
+	CHECK(cold.begin(port));
+	const uint16_t unknown[] = { 12, 3, 1, 2, 13, 30, 3 };
+	module.instructions.clear();
+	CHECK(cold.deleteFingerprintEntries(unknown, 7));
+	CHECK(countInstructions(AS108M_DELETE_CHAR) == 3);
+	for (int i : { 1, 2, 3, 12, 13, 30 })
+		CHECK(module.database.count(i) == 0);
+	CHECK(module.database.count(0) && module.database.count(11));
+
+	// With it, empty pages bridge ranges and known empty IDs are skipped
+	CHECK(reader.readIndexTable(true));
+	uint16_t enrolled = reader.enrolledCount();
+	const uint16_t known[] = { 5, 6, 7, 8, 10, 11, 9, 14, 15, 16, 24, 2 };
+	module.instructions.clear();
+	uint64_t start = g_hostMicros;
+	CHECK(reader.deleteFingerprintEntries(known, 12));
+	printf("  12 IDs deleted with %d DELETE_CHAR in %.1f ms\n", countInstructions(AS108M_DELETE_CHAR), elapsedMs(start));
+	CHECK(countInstructions(AS108M_DELETE_CHAR) == 1);
+	for (int i : { 5, 6, 7, 8, 10, 11, 15, 16, 24 })
+		CHECK(module.database.count(i) == 0);
+	CHECK(module.database.count(17) && module.database.count(23) && module.database.count(25));
+	CHECK(reader.enrolledCount() == enrolled - 8);
+	CHECK(!reader.isSlotUsed(16) && reader.isSlotUsed(17));
+
+	const uint16_t run[] = { 17, 18, 19, 20, 21, 22, 23, 25 };
+	start = g_hostMicros;
+	for (uint16_t ID : run)
+		CHECK(reader.deleteFingerprintEntry(ID));
+	printf("  8 IDs deleted one by one in %.1f ms\n", elapsedMs(start));
+	for (uint16_t ID : run)
+		module.database[ID] = AS108M_SIMULATOR::fingerTemplate(ID);
+	CHECK(reader.readIndexTable(true));
+	module.instructions.clear();
+	start = g_hostMicros;
+	CHECK(reader.deleteFingerprintEntries(run, 8));
+	printf("  8 IDs deleted as a list in %.1f ms\n", elapsedMs(start));
+	CHECK(countInstructions(AS108M_DELETE_CHAR) == 1);
+
+	CHECK(reader.deleteFingerprintRange(0, 40));
+	CHECK(module.database.empty());
+	CHECK(reader.enrolledCount() == 0);
+}
+
+static void testWidePageIds()
+{
+	module.database.clear();
+	module.capacity = 3000;
+	CHECK(reader.readSystemParameters(true).databaseSize == 3000);
+
+	module.finger = 3;
+	module.database[700] = AS108M_SIMULATOR::fingerTemplate(3);
+	AS108M_QUERY_DATA result = reader.searchFingerprint(0, 1000);
+	CHECK(result.found && result.pageId == 700);
+	CHECK(reader.startSearch(0, 1000));
+	while (reader.poll() == AS108M_ASYNC_STATUS::BUSY)
+		g_hostMicros += 100;
+	CHECK(reader.getAsyncResult().pageId == 700);
+	result = reader.getFingerprintMatch(700);
+	CHECK(result.found && result.pageId == 700);
+
+	blinkFinger(module, 4);
+	CHECK(reader.enrollFingerprint(1234, 2));
+	CHECK(module.database.count(1234) == 1);
+	CHECK(reader.startEnroll(2345, 2));
+	while (reader.poll() == AS108M_ASYNC_STATUS::BUSY)
+		g_hostMicros += 100;
+	CHECK(module.database.count(2345) == 1 && reader.getAsyncResult().pageId == 2345);
+	module.onCommand = nullptr;
+
+	// Pages past the cached index table are never taken for empty
+	module.database[2] = AS108M_SIMULATOR::fingerTemplate(1);
+	module.database[3] = AS108M_SIMULATOR::fingerTemplate(1);
+	CHECK(reader.readIndexTable(true));
+	const uint16_t IDs[] = { 2345, 3, 1234, 2, 1235, 5 };
+	module.instructions.clear();
+	CHECK(reader.deleteFingerprintEntries(IDs, 6));
+	CHECK(countInstructions(AS108M_DELETE_CHAR) == 3);
+	CHECK(module.database.size() == 1 && module.database.count(700) == 1);
+
+	// A buffer for every index table page covers them all
+	CHECK(!reader.isSlotUsed(700));
+	byte table[12 * AS108M_INDEX_TABLE_PAGE_SIZE];
+	reader.setIndexTableBuffer(table, 12);
+	module.instructions.clear();
+	CHECK(reader.isSlotUsed(700) && reader.enrolledCount() == 1 && reader.findFreeSlot(700) == 701);
+	CHECK(countInstructions(AS108M_READ_INDEX_TABLE) == 12);
+	reader.setIndexTableBuffer(NULL, 0);
+	CHECK(!reader.isSlotUsed(700) && reader.enrolledCount() == 0);
+	module.capacity = 40;
+}
+
+int main()
+{
+	CHECK(reader.begin(port));
+	testOccupancy();
+	testDeleteLists();
+	testWidePageIds();
+	return testResult("test_index_table");
+}
@@ -0,0 +1,97 @@
+/*
+  Command latencies, timeouts, retry sleep and line traffic counted by the instrumentation hooks.
+  Built with AS108M_ENABLE_INSTRUMENTATION set, see the Makefile.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+#include "SparkFun_AS108M_Manager.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+static AS108M_INSTRUMENTATION instrumentation;
+
+// Readers sharing a port count the packets addressed to them, even though the first one reads them all
+static void testSharedPort()
+{
+	AS108M_SIMULATOR a, b, stranger;
+	HostPort bus;
+	AS108M readerA, readerB;
+	AS108M_MANAGER manager;
+	a.address = 1;
+	b.address = 2;
+	stranger.address = 3;
+	bus.modules = { &a, &b, &stranger };
+	CHECK(readerA.begin(bus, 1));
+	CHECK(readerB.begin(bus, 2));
+	manager.addReader(readerA);
+	manager.addReader(readerB);
+	AS108M_INSTRUMENTATION statsA, statsB;
+	readerA.setInstrumentation(&statsA);
+	readerB.setInstrumentation(&statsB);
+	a.bytesReceived = a.bytesSent = b.bytesSent = 0;
+
+	a.database[1] = b.database[1] = AS108M_SIMULATOR::fingerTemplate(5);
+	a.finger = b.finger = 5;
+	CHECK(readerA.startSearch());
+	CHECK(readerB.startSearch());
+	stranger.queuePacket(AS108M_FLAG_ACK, { 0x00 }, 3000);
+	stranger.queueBytes({ 0x55, 0xaa });
+	while (manager.poll())
+		delay(1);
+
+	CHECK(readerA.getAsyncResult().pageId == 1 && readerB.getAsyncResult().pageId == 1);
+	CHECK(stranger.bytesSent == 11 + 1 + 2 && manager.getUnroutedPackets() == 1);
+	CHECK(statsB.bytesReceived == b.bytesSent);
+	CHECK(statsA.bytesReceived == a.bytesSent + stranger.bytesSent);
+	CHECK(statsA.bytesSent + statsB.bytesSent == a.bytesReceived);
+}
+
+int main()
+{
+	CHECK(reader.begin(port));
+	reader.setInstrumentation(&instrumentation);
+	module.bytesReceived = module.bytesSent = 0;
+
+	module.database[7] = AS108M_SIMULATOR::fingerTemplate(3);
+	module.finger = 3;
+	for (int i = 0; i < 5; i++)
+		CHECK(reader.searchFingerprint().pageId == 7);
+	CHECK(reader.startSearch());
+	while (reader.poll() == AS108M_ASYNC_STATUS::BUSY)
+		delay(1);
+
+	const AS108M_COMMAND_STATS& search = reader.getCommandStats(AS108M_SEARCH);
+	printf("  SEARCH: %lu sent, %lu/%lu/%lu ms min/mean/max\n  ", (unsigned long)search.count, (unsigned long)search.minLatency,
+		(unsigned long)search.meanLatency, (unsigned long)search.maxLatency);
+	for (byte bucket = 0; bucket < AS108M_LATENCY_BUCKETS; bucket++)
+		printf(" <%lu ms: %lu", (unsigned long)reader.getLatencyBucketLimit(bucket), (unsigned long)search.histogram[bucket]);
+	printf("\n");
+	CHECK(search.count == 6);
+	CHECK(reader.getCommandStats(AS108M_GET_IMAGE).count == 6);
+	CHECK(instrumentation.bytesSent == module.bytesReceived);
+	CHECK(instrumentation.bytesReceived == module.bytesSent);
+
+	// Three lost replies and two backoffs of 20 and 40 ms
+	module.mute = true;
+	reader.getValidTemplateCount();
+	module.mute = false;
+	CHECK(instrumentation.timeouts == 3 && reader.getCommandStats(AS108M_VALID_TEMPLATE_NUM).timeouts == 3);
+	CHECK(instrumentation.sleepTime == 20 + 40);
+
+	MemoryStream sink;
+	CHECK(reader.uploadTemplate(sink));
+	CHECK(reader.getCommandStats(AS108M_UP_CHAR).count == 1);
+	CHECK(instrumentation.bytesReceived == module.bytesSent);
+
+	// Clearing starts over, and without anywhere to collect into nothing is counted
+	reader.resetInstrumentation();
+	CHECK(instrumentation.bytesSent == 0 && reader.getCommandStats(AS108M_SEARCH).count == 0);
+	reader.setInstrumentation(NULL);
+	CHECK(reader.isConnected());
+	CHECK(instrumentation.bytesSent == 0 && reader.getCommandStats(AS108M_CANCEL).count == 0);
+
+	testSharedPort();
+	return testResult("test_instrumentation");
+}
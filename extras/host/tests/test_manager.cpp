@@ -0,0 +1,239 @@
+/*
+  Several readers driven by one manager, each on its own port or sharing one.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Manager.h"
+
+static int completions[AS108M_MAX_READERS];
+
+static void countCompletion(byte index, AS108M_ASYNC_STATUS status)
+{
+	if (status == AS108M_ASYNC_STATUS::COMPLETED)
+		completions[index]++;
+}
+
+// Polls until the manager has nothing left to do, false if it never gets there
+static bool pollUntilIdle(AS108M_MANAGER& manager)
+{
+	for (int i = 0; i < 100000; i++)
+	{
+		if (!manager.poll())
+			return true;
+		g_hostMicros += 200;
+	}
+	return false;
+}
+
+// Every reader identifies fingers that come and go, out of phase with each other, for 10 s
+static void testIdentifyStreams(int count, bool shared)
+{
+	AS108M_SIMULATOR modules[AS108M_MAX_READERS];
+	HostPort ports[AS108M_MAX_READERS];
+	HostPort bus;
+	AS108M readers[AS108M_MAX_READERS];
+	AS108M_MANAGER manager;
+	memset(completions, 0, sizeof(completions));
+
+	uint64_t start = g_hostMicros;
+	for (int i = 0; i < count; i++)
+	{
+		AS108M_SIMULATOR* module = &modules[i];
+		module->address = shared ? 0x1000 + i : 0xffffffff;
+		module->database[3] = AS108M_SIMULATOR::fingerTemplate(7);
+		int phase = i * 97;
+		module->onCommand = [module, phase, start](byte instruction)
+		{
+			if (instruction == AS108M_GET_IMAGE)
+				module->finger = ((g_hostMicros - start) / 1000 + phase) % 500 < 350 ? 7 : -1;
+		};
+
+		if (shared)
+		{
+			bus.modules.push_back(module);
+			CHECK(readers[i].begin(bus, module->address));
+		}
+		else
+		{
+			ports[i].modules.push_back(module);
+			CHECK(readers[i].begin(ports[i]));
+		}
+		CHECK(manager.addReader(readers[i]));
+	}
+
+	manager.setCallback(countCompletion);
+	CHECK(manager.startIdentifyStreams());
+	start = g_hostMicros;
+	while (g_hostMicros - start < 10000000)
+	{
+		manager.poll();
+		g_hostMicros += 200;
+	}
+
+	int total = 0;
+	for (int i = 0; i < count; i++)
+		total += completions[i];
+	printf("  %s port, %d readers: %.1f identifies/s,", shared ? "shared" : "own", count, total / 10.0);
+	for (int i = 0; i < count; i++)
+	{
+		AS108M_READER_STATS stats = manager.getStats(i);
+		printf(" [%lu ok %lu failed, %lu/%lu ms]", (unsigned long)stats.completed, (unsigned long)stats.failed,
+			(unsigned long)stats.averageLatency, (unsigned long)stats.maxLatency);
+		CHECK(stats.completed > 5);
+	}
+	printf("\n");
+
+	manager.stopIdentifyStreams();
+	CHECK(pollUntilIdle(manager));
+}
+
+// Packets for a peer or for no reader at all must not end a reader's operation
+static void testRouting()
+{
+	AS108M_SIMULATOR a, b, stranger;
+	HostPort bus;
+	AS108M readerA, readerB;
+	AS108M_MANAGER manager;
+	a.address = 1;
+	b.address = 2;
+	stranger.address = 3;
+	bus.modules = { &a, &b, &stranger };
+	CHECK(readerA.begin(bus, 1));
+	CHECK(readerB.begin(bus, 2));
+	manager.addReader(readerA);
+	manager.addReader(readerB);
+
+	a.database[1] = AS108M_SIMULATOR::fingerTemplate(5);
+	a.finger = 5;
+	CHECK(readerA.startSearch());
+	b.queuePacket(AS108M_FLAG_ACK, { 0x00 }, 100);
+	stranger.queuePacket(AS108M_FLAG_ACK, { 0x00 }, 8000);
+	b.queuePacket(AS108M_FLAG_ACK, { 0x00 }, 500);
+	b.queuePacket(AS108M_FLAG_ACK, { 0x00 }, 600);
+	CHECK(pollUntilIdle(manager));
+	CHECK(readerA.getAsyncStatus() == AS108M_ASYNC_STATUS::COMPLETED);
+	CHECK(readerA.getAsyncResult().pageId == 1);
+	CHECK(manager.getUnroutedPackets() == 1);
+	CHECK(manager.getStats(1).lostPackets == 1);
+
+	// What was queued for B before it started is not taken for its reply
+	b.finger = -1;
+	CHECK(readerB.startMatch(0));
+	CHECK(pollUntilIdle(manager));
+	CHECK(readerB.getAsyncStatus() == AS108M_ASYNC_STATUS::FAILED);
+	CHECK(readerB.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+
+	// Blocking calls on a shared port still check the address, and routing a peer's packets does not change it
+	CHECK(readerA.readSystemParameters(true).address == 1);
+	CHECK(readerB.startMatch(0));
+	CHECK(pollUntilIdle(manager));
+	CHECK(readerB.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+	CHECK(readerA.getAddress() == 1 && readerB.getAddress() == 2);
+	b.extraDelay = 10000;
+	stranger.queuePacket(AS108M_FLAG_ACK, { 0x00, 0x00, 0x05 }, 1000);
+	readerB.getValidTemplateCount();
+	CHECK(readerB.response == AS108M_RESPONSE_CODES::AS108M_ADDRESS_MISMATCH);
+	b.extraDelay = 0;
+	CHECK(readerB.getValidTemplateCount() == b.database.size() && readerB.response == AS108M_RESPONSE_CODES::AS108M_OK);
+
+	AS108M spare[AS108M_MAX_READERS];
+	for (int i = 2; i < AS108M_MAX_READERS; i++)
+		CHECK(manager.addReader(spare[i]));
+	CHECK(!manager.addReader(spare[0]));
+}
+
+// Enrolling on one reader and storing the template on all of them
+static void testDeploy()
+{
+	AS108M_SIMULATOR modules[4];
+	HostPort ports[4];
+	AS108M readers[4];
+	AS108M_MANAGER manager;
+	for (int i = 0; i < 4; i++)
+	{
+		ports[i].modules.push_back(&modules[i]);
+		ports[i].txBufferSize = 64;
+		CHECK(readers[i].begin(ports[i]));
+		manager.addReader(readers[i]);
+	}
+
+	blinkFinger(modules[0], 4, 1, 1);
+	byte buffer[600];
+	uint64_t start = g_hostMicros;
+	byte stored = manager.enrollTemplate(0, 9, buffer, sizeof(buffer), 2);
+	printf("  enrolled and stored on %d readers in %.0f ms\n", stored, elapsedMs(start));
+	CHECK(stored == 4);
+	for (int i = 0; i < 4; i++)
+	{
+		CHECK(modules[i].database.count(9) && modules[i].database[9] == AS108M_SIMULATOR::fingerTemplate(4));
+		CHECK(readers[i].isSlotUsed(9));
+	}
+	CHECK(manager.getDeployResult(0).success);
+
+	// All readers at once against one after the other
+	std::vector<uint8_t> data = AS108M_SIMULATOR::fingerTemplate(6);
+	start = g_hostMicros;
+	CHECK(manager.deployTemplate(data.data(), data.size(), 12) == 4);
+	double batch = elapsedMs(start);
+	start = g_hostMicros;
+	for (int i = 0; i < 4; i++)
+	{
+		MemoryStream source(data);
+		CHECK(readers[i].downloadTemplate(source, data.size()) && readers[i].storeTemplate(13));
+	}
+	printf("  4 readers: deployed in %.0f ms, one after the other in %.0f ms\n", batch, elapsedMs(start));
+	for (int i = 0; i < 4; i++)
+		CHECK(modules[i].database[12] == data && modules[i].database[13] == data);
+
+	// A reader that fails is reported, the others still get the template
+	modules[2].capacity = 10;
+	CHECK(readers[2].readSystemParameters(true).databaseSize == 10);
+	CHECK(manager.deployTemplate(data.data(), data.size(), 20) == 3);
+	CHECK(!manager.getDeployResult(2).success);
+	CHECK(manager.getDeployResult(2).response == AS108M_RESPONSE_CODES::AS108M_ADDRESS_EXCEEDING_DATABASE_LIMIT);
+
+	// Readers sharing a port take turns
+	AS108M_SIMULATOR a, b;
+	HostPort bus;
+	a.address = 1;
+	b.address = 2;
+	bus.modules = { &a, &b };
+	bus.txBufferSize = 64;
+	AS108M readerA, readerB;
+	CHECK(readerA.begin(bus, 1));
+	CHECK(readerB.begin(bus, 2));
+	AS108M_MANAGER mixed;
+	mixed.addReader(readerA);
+	mixed.addReader(readerB);
+	mixed.addReader(readers[3]);
+	CHECK(mixed.deployTemplate(data.data(), data.size(), 5) == 3);
+	CHECK(a.database[5] == data && b.database[5] == data && modules[3].database[5] == data);
+
+	// A busy reader's reply is left for it and its last transfer is still reported
+	a.extraDelay = 50000;
+	uint32_t commands = a.commands;
+	CHECK(readerA.startMatch(0));
+	CHECK(mixed.poll());
+	CHECK(mixed.deployTemplate(data.data(), data.size(), 6) == 2);
+	CHECK(b.database[6] == data && !a.database.count(6));
+	CHECK(readerA.getTransferStats().bytes == data.size());
+	CHECK(pollUntilIdle(mixed));
+	CHECK(readerA.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+	CHECK(readerA.getAsyncStatus() == AS108M_ASYNC_STATUS::FAILED && a.commands == commands + 1);
+	a.extraDelay = 0;
+
+	// An empty template is not deployed at all
+	commands = b.commands;
+	CHECK(mixed.deployTemplate(data.data(), 0, 7) == 0 && b.commands == commands);
+}
+
+int main()
+{
+	for (int count = 1; count <= AS108M_MAX_READERS; count++)
+		testIdentifyStreams(count, false);
+	for (int count = 1; count <= AS108M_MAX_READERS; count++)
+		testIdentifyStreams(count, true);
+	testRouting();
+	testDeploy();
+	return testResult("test_manager");
+}
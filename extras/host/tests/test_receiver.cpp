@@ -0,0 +1,112 @@
+/*
+  Replies found again behind line noise and torn packets.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+#include <random>
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+
+// A packet as the module frames it
+static std::vector<uint8_t> packet(uint32_t address, byte flag, const std::vector<uint8_t>& payload)
+{
+	uint16_t length = payload.size() + 2;
+	std::vector<uint8_t> data = { 0xef, 0x01, static_cast<uint8_t>(address >> 24), static_cast<uint8_t>(address >> 16),
+		static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address), flag, static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) };
+	uint16_t checkSum = flag + (length >> 8) + (length & 0xff);
+	for (uint8_t value : payload)
+	{
+		data.push_back(value);
+		checkSum += value;
+	}
+	data.push_back(checkSum >> 8);
+	data.push_back(checkSum & 0xff);
+	return data;
+}
+
+// Random bytes rich in header bytes, sometimes followed by the start of a packet that never ends
+static std::vector<uint8_t> noise(std::mt19937& random)
+{
+	std::vector<uint8_t> data(random() % 40);
+	for (uint8_t& value : data)
+	{
+		value = random();
+		if (random() % 8 == 0)
+			value = 0xef;
+		if (random() % 8 == 0)
+			value = 0x01;
+	}
+	if (random() % 4 == 0)
+	{
+		std::vector<uint8_t> torn = packet(module.address, AS108M_FLAG_ACK, { 0x00, 0x01, 0x02 });
+		data.insert(data.end(), torn.begin(), torn.begin() + random() % torn.size());
+	}
+	return data;
+}
+
+static void testFuzz()
+{
+	std::mt19937 random(1234);
+	std::vector<uint8_t> noiseBytes;
+	module.onCommand = [&noiseBytes](byte)
+	{
+		module.queueBytes(noiseBytes);
+	};
+
+	int recovered = 0;
+	const int attempts = 5000;
+	uint64_t noiseTotal = 0;
+	uint64_t start = g_hostMicros;
+	AS108M_RETRY_POLICY policy;
+	policy.maxAttempts = 1;
+	policy.timeout = 50;
+	reader.setRetryPolicy(policy);
+	for (int i = 0; i < attempts; i++)
+	{
+		module.database.clear();
+		int count = random() % 40;
+		for (int page = 0; page < count; page++)
+			module.database[page] = { 0x00 };
+		noiseBytes = noise(random);
+		noiseTotal += noiseBytes.size();
+		uint16_t reported = reader.getValidTemplateCount();
+		if (reader.response == AS108M_RESPONSE_CODES::AS108M_OK && reported == count)
+			recovered++;
+		else
+			module.reset();
+	}
+	printf("  %d/%d replies recovered behind %llu noise bytes, %lu discarded, %.2f ms each\n", recovered, attempts,
+		(unsigned long long)noiseTotal, (unsigned long)reader.getDiscardedBytes(), elapsedMs(start) / attempts);
+	CHECK(recovered > attempts * 97 / 100);
+	reader.setRetryPolicy(AS108M_RETRY_POLICY());
+	module.onCommand = nullptr;
+}
+
+static void testSearchThroughNoise()
+{
+	// A header, a stray 0xef and a header of a packet that is cut short in front of every reply
+	const std::vector<uint8_t> noiseBytes = { 0x12, 0xef, 0x33, 0xef, 0x01, 0xff, 0xff, 0xff, 0xff, 0x55, 0x00 };
+	module.onCommand = [&noiseBytes](byte)
+	{
+		module.queueBytes(noiseBytes);
+	};
+	module.database.clear();
+	module.database[2] = AS108M_SIMULATOR::fingerTemplate(1);
+	module.finger = 1;
+	uint32_t discarded = reader.getDiscardedBytes();
+	AS108M_QUERY_DATA result = reader.searchFingerprint();
+	CHECK(result.found && result.pageId == 2);
+	CHECK(reader.getDiscardedBytes() > discarded);
+	module.onCommand = nullptr;
+}
+
+int main()
+{
+	CHECK(reader.begin(port));
+	testFuzz();
+	testSearchThroughNoise();
+	return testResult("test_receiver");
+}
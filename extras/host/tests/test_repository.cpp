@@ -0,0 +1,133 @@
+/*
+  Keeping readers in line with a template repository held in host storage.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+#include "SparkFun_AS108M_Repository.h"
+#include <string.h>
+
+// Storage in RAM, filled like erased flash
+class RamStorage : public AS108M_STORAGE
+{
+public:
+	std::vector<uint8_t> memory = std::vector<uint8_t>(65536, 0xff);
+
+	bool read(uint32_t offset, byte* data, uint16_t size)
+	{
+		if (offset + size > memory.size())
+			return false;
+		memcpy(data, &memory[offset], size);
+		return true;
+	}
+
+	bool write(uint32_t offset, const byte* data, uint16_t size)
+	{
+		if (offset + size > memory.size())
+			return false;
+		memcpy(&memory[offset], data, size);
+		return true;
+	}
+};
+
+static AS108M_SIMULATOR module1, module2;
+static HostPort port1(module1), port2(module2);
+static AS108M reader1, reader2;
+static RamStorage storage;
+static AS108M_REPOSITORY repository;
+
+static void printSync(const char* what)
+{
+	AS108M_SYNC_STATS stats = repository.getSyncStats();
+	printf("  %-16s %2u checked, %2u unchanged, %2u sent, %u deleted, %u failed, %5lu bytes, %5lu ms\n", what, stats.checked,
+		stats.unchanged, stats.transferred, stats.deleted, stats.failed, (unsigned long)stats.bytes, (unsigned long)stats.elapsed);
+}
+
+// Offset of a byte in the middle of a slot's template
+static uint32_t templateByte(byte slot)
+{
+	return 12 + repository.getSlotCount() * 6 + slot * repository.getSlotSize() + 100;
+}
+
+int main()
+{
+	CHECK(reader1.begin(port1));
+	CHECK(reader2.begin(port2));
+
+	CHECK(!repository.begin(storage));
+	CHECK(!repository.format(storage, 0));
+	CHECK(repository.format(storage, 0x12345678));
+	AS108M_REPOSITORY reopened;
+	CHECK(reopened.begin(storage));
+	CHECK(reopened.getId() == 0x12345678 && reopened.getSlotCount() == 40);
+
+	// 30 templates enrolled on the first reader
+	for (int i = 0; i < 30; i++)
+		module1.database[i] = AS108M_SIMULATOR::fingerTemplate(i + 1);
+	for (int i = 0; i < 30; i++)
+		CHECK(repository.importTemplate(reader1, i));
+	CHECK(repository.getSlotInfo(5).length == 512 && repository.getSlotInfo(5).version == 1);
+	MemoryStream stored;
+	CHECK(repository.getTemplate(5, stored));
+	CHECK(stored.data == AS108M_SIMULATOR::fingerTemplate(6));
+
+	// The second reader holds a template the repository does not know
+	module2.database[35] = AS108M_SIMULATOR::fingerTemplate(99);
+	CHECK(repository.syncReader(reader2));
+	printSync("first sync");
+	CHECK(repository.getSyncStats().transferred == 30 && repository.getSyncStats().deleted == 1);
+	for (int i = 0; i < 30; i++)
+		CHECK(module2.database.count(i) && module2.database[i] == AS108M_SIMULATOR::fingerTemplate(i + 1));
+	CHECK(!module2.database.count(35));
+
+	CHECK(repository.syncReader(reader2));
+	printSync("up to date");
+	CHECK(repository.getSyncStats().transferred == 0 && repository.getSyncStats().unchanged == 40);
+
+	MemoryStream changed(AS108M_SIMULATOR::fingerTemplate(77));
+	CHECK(repository.putTemplate(3, changed, 512));
+	CHECK(repository.removeTemplate(10));
+	CHECK(repository.syncReader(reader2));
+	printSync("two changes");
+	CHECK(repository.getSyncStats().transferred == 1 && repository.getSyncStats().deleted == 1);
+	CHECK(module2.database[3] == AS108M_SIMULATOR::fingerTemplate(77) && !module2.database.count(10));
+
+	// A template deleted on the reader behind the repository's back
+	module2.database.erase(20);
+	CHECK(repository.syncReader(reader2));
+	printSync("local deletion");
+	CHECK(repository.getSyncStats().transferred == 1);
+
+	// A template corrupted in storage is not sent
+	changed.position = 0;
+	CHECK(repository.putTemplate(8, changed, 512));
+	storage.memory[templateByte(8)] ^= 0xff;
+	CHECK(!repository.syncReader(reader2));
+	printSync("corrupted slot");
+	CHECK(repository.getSyncStats().failed == 1);
+	CHECK(module2.database[8] == AS108M_SIMULATOR::fingerTemplate(9));
+	storage.memory[templateByte(8)] ^= 0xff;
+	CHECK(repository.syncReader(reader2));
+	CHECK(module2.database[8] == AS108M_SIMULATOR::fingerTemplate(77));
+
+	// A template that can't be stored leaves its slot empty rather than holding the old entry over half a template
+	MemoryStream shortSource(std::vector<uint8_t>(100, 0x55));
+	CHECK(!repository.putTemplate(3, shortSource, 512));
+	CHECK(repository.getSlotInfo(3).length == 0);
+	CHECK(!repository.getTemplate(3, stored));
+	CHECK(repository.syncReader(reader2));
+	CHECK(repository.getSyncStats().deleted == 1 && !module2.database.count(3));
+	module1.onCommand = [](byte instruction) { module1.mute = (instruction == AS108M_UP_CHAR); };
+	CHECK(!repository.importTemplate(reader1, 4));
+	module1.onCommand = nullptr;
+	module1.mute = false;
+	CHECK(repository.getSlotInfo(4).length == 0);
+
+	// A new repository syncs readers from scratch
+	CHECK(repository.format(storage, 0x12345679));
+	CHECK(repository.syncReader(reader2));
+	printSync("after format");
+	CHECK(module2.database.empty());
+
+	return testResult("test_repository");
+}
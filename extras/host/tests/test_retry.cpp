@@ -0,0 +1,223 @@
+/*
+  Commands sent again after a lost reply, and per command reply timeouts.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+
+// Number of SEARCH replies still to be lost
+static int lostSearches = 0;
+
+static int countInstructions(byte instruction)
+{
+	int count = 0;
+	for (byte sent : module.instructions)
+		count += sent == instruction;
+	return count;
+}
+
+static void testRetries()
+{
+	AS108M_RETRY_POLICY policy;
+	policy.timeout = 300;
+	reader.setRetryPolicy(policy);
+	module.database[7] = AS108M_SIMULATOR::fingerTemplate(3);
+	module.finger = 3;
+	module.onCommand = [](byte instruction)
+	{
+		module.mute = instruction == AS108M_SEARCH && lostSearches > 0 && lostSearches-- > 0;
+	};
+
+	// One lost reply costs one more SEARCH, not a new capture
+	lostSearches = 1;
+	module.instructions.clear();
+	AS108M_QUERY_DATA result = reader.searchFingerprint();
+	CHECK(result.found && result.pageId == 7);
+	CHECK(countInstructions(AS108M_GET_IMAGE) == 1 && countInstructions(AS108M_SEARCH) == 2);
+	AS108M_RETRY_STATS stats = reader.getRetryStats();
+	CHECK(stats.retries == 1 && stats.recovered == 1 && stats.exhausted == 0);
+
+	// Given up after the last attempt
+	reader.resetRetryStats();
+	lostSearches = 5;
+	reader.searchFingerprint();
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT);
+	stats = reader.getRetryStats();
+	CHECK(stats.retries == 2 && stats.exhausted == 1);
+
+	// The same without blocking
+	reader.resetRetryStats();
+	lostSearches = 1;
+	module.mute = false;
+	CHECK(reader.startSearch());
+	AS108M_ASYNC_STATUS status;
+	while ((status = reader.poll()) == AS108M_ASYNC_STATUS::BUSY)
+		delay(1);
+	CHECK(status == AS108M_ASYNC_STATUS::COMPLETED);
+	CHECK(reader.getAsyncResult().pageId == 7);
+	stats = reader.getRetryStats();
+	CHECK(stats.retries == 1 && stats.recovered == 1);
+
+	// Transfers are never sent again
+	reader.resetRetryStats();
+	module.onCommand = [](byte instruction)
+	{
+		module.mute = instruction == AS108M_UP_CHAR;
+	};
+	MemoryStream sink;
+	CHECK(!reader.uploadTemplate(sink));
+	CHECK(reader.getRetryStats().retries == 0);
+	module.onCommand = nullptr;
+	module.mute = false;
+	reader.setRetryPolicy(AS108M_RETRY_POLICY());
+
+	// The UP_CHAR reply could still come, the next command makes sure it does not or is dropped
+	CHECK(reader.isConnected());
+}
+
+static void testTimeouts()
+{
+	AS108M_RETRY_POLICY policy;
+	policy.maxAttempts = 1;
+	reader.setRetryPolicy(policy);
+	CHECK(reader.getCommandTimeout(AS108M_CANCEL) == 50);
+	CHECK(reader.getCommandTimeout(AS108M_SEARCH) == 8000);
+	CHECK(reader.getCommandTimeout(0x55) == AS108M_DEFAULT_COMMAND_TIMEOUT);
+
+	// Quick commands are given up on quickly
+	module.mute = true;
+	uint64_t start = g_hostMicros;
+	reader.getValidTemplateCount();
+	printf("  lost VALID_TEMPLATE_NUM reply given up after %.0f ms\n", elapsedMs(start));
+	CHECK(elapsedMs(start) < 60);
+
+	CHECK(reader.setCommandTimeout(AS108M_VALID_TEMPLATE_NUM, 20));
+	start = g_hostMicros;
+	reader.getValidTemplateCount();
+	CHECK(elapsedMs(start) < 30);
+	CHECK(reader.setCommandTimeout(AS108M_VALID_TEMPLATE_NUM, 0));
+	CHECK(reader.getCommandTimeout(AS108M_VALID_TEMPLATE_NUM) == 50);
+
+	// Overrides have a fixed number of slots
+	for (byte i = 0; i < AS108M_MAX_TIMEOUT_OVERRIDES; i++)
+		CHECK(reader.setCommandTimeout(0x40 + i, 10));
+	CHECK(!reader.setCommandTimeout(0x50, 10));
+	for (byte i = 0; i < AS108M_MAX_TIMEOUT_OVERRIDES; i++)
+		CHECK(reader.setCommandTimeout(0x40 + i, 0));
+
+	// A search taking 6 s is still waited for
+	module.mute = false;
+	module.onCommand = [](byte instruction)
+	{
+		module.extraDelay = instruction == AS108M_SEARCH ? 6000000 : 0;
+	};
+	AS108M_QUERY_DATA result = reader.searchFingerprint();
+	CHECK(result.found && result.pageId == 7);
+	module.onCommand = nullptr;
+	module.extraDelay = 0;
+}
+
+// Replies that come in after the command was given up on must not be taken for the reply to a later one
+static void testLateReplies()
+{
+	AS108M_RETRY_POLICY policy;
+	policy.backoff = 2;
+	reader.setRetryPolicy(policy);
+	CHECK(reader.setCommandTimeout(AS108M_GET_CHAR, 20));
+
+	// GET_CHAR takes 30 ms, every attempt times out and its reply shows up while the next command is under way
+	module.finger = 9;
+	AS108M_QUERY_DATA result = reader.searchFingerprint();
+	CHECK(!result.found && reader.response == AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT);
+	CHECK(reader.startSearch());
+	AS108M_ASYNC_STATUS status;
+	while ((status = reader.poll()) == AS108M_ASYNC_STATUS::BUSY)
+		g_hostMicros += 100;
+	CHECK(status == AS108M_ASYNC_STATUS::FAILED && !reader.getAsyncResult().found);
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT);
+
+	module.finger = -1;
+	CHECK(!reader.captureImage());
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+	CHECK(reader.getValidTemplateCount() == module.database.size());
+
+	// Only the first GET_CHAR is slow: its late reply is dropped and the second attempt gets its own
+	CHECK(reader.setCommandTimeout(AS108M_GET_CHAR, 40));
+	int getChars = 0;
+	module.onCommand = [&getChars](byte instruction)
+	{
+		module.extraDelay = (instruction == AS108M_GET_CHAR && getChars++ == 0) ? 30000 : 0;
+	};
+	module.finger = 3;
+	reader.resetRetryStats();
+	result = reader.searchFingerprint();
+	CHECK(result.found && result.pageId == 7);
+	CHECK(reader.getRetryStats().retries == 1 && reader.getRetryStats().recovered == 1);
+	CHECK(reader.getValidTemplateCount() == module.database.size());
+
+	getChars = 0;
+	CHECK(reader.startSearch());
+	while ((status = reader.poll()) == AS108M_ASYNC_STATUS::BUSY)
+		g_hostMicros += 100;
+	CHECK(status == AS108M_ASYNC_STATUS::COMPLETED && reader.getAsyncResult().pageId == 7);
+	module.finger = -1;
+	CHECK(!reader.captureImage() && reader.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+
+	// A reply nobody asked for is dropped before the next command goes out
+	module.onCommand = nullptr;
+	module.queuePacket(AS108M_FLAG_ACK, { 0x00 }, 0);
+	g_hostMicros += 10000;
+	CHECK(!reader.captureImage() && reader.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+
+	CHECK(reader.setCommandTimeout(AS108M_GET_CHAR, 0));
+	reader.setRetryPolicy(AS108M_RETRY_POLICY());
+}
+
+// However many attempts a command is given, the wait before each of them stops growing
+static void testLongBackoff()
+{
+	AS108M_RETRY_POLICY policy;
+	policy.maxAttempts = 40;
+	policy.timeout = 10;
+	policy.backoff = 100;
+	reader.setRetryPolicy(policy);
+	reader.resetRetryStats();
+	module.mute = true;
+
+	// 100, 200, 400 and 800 ms, then the maximum for each of the 35 other retries.
+	// Without a cap the waits would add up to hours, or wrap around to nothing
+	uint32_t waited = 1500 + 35UL * AS108M_MAX_RETRY_BACKOFF;
+	uint64_t start = g_hostMicros;
+	reader.getValidTemplateCount();
+	printf("  40 attempts given up after %.0f ms\n", elapsedMs(start));
+	CHECK(reader.getRetryStats().retries == 39 && reader.getRetryStats().exhausted == 1);
+	CHECK(elapsedMs(start) >= waited && elapsedMs(start) < waited + 40 * 20);
+
+	start = g_hostMicros;
+	CHECK(reader.startSearch());
+	AS108M_ASYNC_STATUS status;
+	while ((status = reader.poll()) == AS108M_ASYNC_STATUS::BUSY)
+		g_hostMicros += 1000;
+	CHECK(status == AS108M_ASYNC_STATUS::FAILED);
+	CHECK(reader.getRetryStats().retries == 78 && reader.getRetryStats().exhausted == 2);
+
+	// GET_IMAGE may take longer than the first backoffs, the attempts after them wait for its late reply too
+	CHECK(elapsedMs(start) >= waited && elapsedMs(start) < waited + 40 * 200);
+
+	module.mute = false;
+	reader.setRetryPolicy(AS108M_RETRY_POLICY());
+}
+
+int main()
+{
+	CHECK(reader.begin(port));
+	testRetries();
+	testTimeouts();
+	testLateReplies();
+	testLongBackoff();
+	return testResult("test_retry");
+}
@@ -0,0 +1,120 @@
+/*
+  Template and image transfers at every packet size, and transfers cut short.
+*/
+
+#include "HostTest.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+
+static AS108M_SIMULATOR module;
+static HostPort port(module);
+static AS108M reader;
+
+// Counts the bytes of an image and those that differ from the simulator's pattern
+class ImageCheck : public Print
+{
+public:
+	uint32_t count = 0;
+	uint32_t errors = 0;
+
+	size_t write(uint8_t value)
+	{
+		errors += value != (uint8_t)count;
+		count++;
+		return 1;
+	}
+};
+
+static void printStats(const char* what, uint16_t packetSize)
+{
+	AS108M_TRANSFER_STATS stats = reader.getTransferStats();
+	printf("  %-8s %3u B packets: %5lu bytes, %3lu packets, %4lu ms, %5lu B/s\n", what, packetSize, (unsigned long)stats.bytes,
+		(unsigned long)stats.packets, (unsigned long)stats.elapsed, (unsigned long)stats.bytesPerSecond);
+}
+
+static void testTemplates()
+{
+	const AS108M_PACKET_SIZE sizes[] = { AS108M_PACKET_SIZE::AS108M_32_BYTES, AS108M_PACKET_SIZE::AS108M_64_BYTES,
+		AS108M_PACKET_SIZE::AS108M_128_BYTES, AS108M_PACKET_SIZE::AS108M_256_BYTES };
+	for (AS108M_PACKET_SIZE size : sizes)
+	{
+		CHECK(reader.setPacketSize(size));
+		uint16_t packetSize = reader.getPacketSize();
+		CHECK(packetSize == (32 << (int)size));
+
+		module.charBuffer[1] = AS108M_SIMULATOR::fingerTemplate(4);
+		MemoryStream uploaded;
+		CHECK(reader.uploadTemplate(uploaded, AS108M_BUFFER_ID_1));
+		CHECK(uploaded.data == AS108M_SIMULATOR::fingerTemplate(4));
+		CHECK(reader.getTransferStats().bytes == uploaded.data.size());
+		printStats("upload", packetSize);
+
+		MemoryStream source(AS108M_SIMULATOR::fingerTemplate(6));
+		CHECK(reader.downloadTemplate(source, source.data.size(), AS108M_BUFFER_ID_2));
+		printStats("download", packetSize);
+
+		// The module has it once the last packet is on the line
+		CHECK(reader.isConnected());
+		CHECK(module.charBuffer[2] == AS108M_SIMULATOR::fingerTemplate(6));
+	}
+
+	// An empty character buffer has nothing to upload
+	module.charBuffer[3].clear();
+	MemoryStream uploaded;
+	CHECK(!reader.uploadTemplate(uploaded, 3));
+	CHECK(reader.isConnected());
+}
+
+static void testImages()
+{
+	ImageCheck none;
+	module.finger = -1;
+	CHECK(!reader.captureImage());
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER);
+
+	module.finger = 1;
+	CHECK(reader.captureImage());
+	for (int size : { 3200, 12800, 36864 })
+	{
+		module.imageSize = size;
+		ImageCheck image;
+		CHECK(reader.uploadImage(image));
+		CHECK(image.count == (uint32_t)size && image.errors == 0);
+		printStats("image", reader.getPacketSize());
+	}
+	module.imageSize = 160 * 160 / 2;
+}
+
+static void testShortSource()
+{
+	CHECK(reader.setPacketSize(AS108M_PACKET_SIZE::AS108M_128_BYTES));
+
+	// The source runs dry before the size it was announced with
+	MemoryStream source(std::vector<uint8_t>(100, 1));
+	module.charBuffer[2] = AS108M_SIMULATOR::fingerTemplate(7);
+	CHECK(!reader.downloadTemplate(source, 512, AS108M_BUFFER_ID_2));
+	CHECK(reader.response == AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT);
+
+	// Its last packet is rejected rather than completed with the next command, which goes through
+	uint32_t commands = module.commands;
+	CHECK(reader.isConnected());
+	CHECK(module.commands == commands + 1);
+	CHECK(module.charBuffer[2] == AS108M_SIMULATOR::fingerTemplate(7));
+
+	// Nothing at all is not even announced
+	MemoryStream empty;
+	commands = module.commands;
+	CHECK(!reader.downloadTemplate(empty, 0, AS108M_BUFFER_ID_2));
+	CHECK(module.commands == commands);
+	CHECK(reader.isConnected());
+}
+
+int main()
+{
+	// Downloads are paced by the line like on a UART with a small transmit buffer
+	port.txBufferSize = 64;
+	CHECK(reader.begin(port));
+	testTemplates();
+	testImages();
+	testShortSource();
+	return testResult("test_transfer");
+}
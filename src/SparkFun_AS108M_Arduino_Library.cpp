@@ -18,34 +18,142 @@ https://www.sparkfun.com/products/17151
 
 #include "SparkFun_AS108M_Constants.h"
 #include "SparkFun_AS108M_Arduino_Library.h"
+#include "SparkFun_AS108M_Manager.h"
 
 #define SERIAL_BUFFER_SIZE 256
 
+// Maps the confirm code replied by the AS108M to AS108M_RESPONSE_CODES.
+// Entries 0x00 to 0x21 are indexed by confirm code, entries 0x22 onwards hold confirm codes 0xf0 to 0xf6.
+static const byte confirmCodeTable[] PROGMEM =
+{
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_OK),										// 0x00
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR),				// 0x01
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_NO_FINGER),								// 0x02
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_GET_FINGERPRINT_IMAGE_FAILED),				// 0x03
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_DRY_TOO_LIGHT),			// 0x04
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_HUMID_TOO_BLURRY),			// 0x05
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_AMORPHOUS),				// 0x06
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_LITTLE_MINUTIAES),			// 0x07
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_UNMATCHED),					// 0x08
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_NO_FINGERPRINT_FOUND),						// 0x09
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_MERGING_FAILED),							// 0x0a
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_ADDRESS_EXCEEDING_DATABASE_LIMIT),			// 0x0b
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_TEMPLATE_READING_ERROR_INVALID_TEMPLATE),	// 0x0c
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FEATURE_UPLOAD_FAILED),					// 0x0d
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_CANNOT_RECEIVE_CONTINUOUS_PACKETS),		// 0x0e
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_IMAGE_UPLOADING_FAILED),					// 0x0f
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_IMAGE_DELETING_FAILED),					// 0x10
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_DATABASE_CLEAR_FAILED),		// 0x11
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_CANNOT_IN_LOW_POWER_CONSUMPTION),			// 0x12
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_INVALID_PASSWORD),							// 0x13
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_SYSTEM_RESET_FAILED),						// 0x14
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_NO_VALID_ORIGINAL_IMAGE_ON_BUFFER),		// 0x15
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_ONLINE_UPGRADING_FAILED),					// 0x16
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_INCOMPLETE_OR_STILL_FINGERPRINT),			// 0x17
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FLASH_READ_WRITE_ERROR),					// 0x18
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_UNDEFINED_ERROR),							// 0x19
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_INVALID_REGISTER),							// 0x1a
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_REGISTER_DISTRIBUTING_CONTENT_WRONG_NUMBER),	// 0x1b
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_NOTEPAD_PAGE_APPOINTING_ERROR),			// 0x1c
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_PORT_OPERATION_FAILED),					// 0x1d
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_AUTOMATIC_ENROLL_FAILED),					// 0x1e
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_DATABASE_FULL),				// 0x1f
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_RESERVED),									// 0x20
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_MUST_VERIFY_PASSWORD),						// 0x21
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_CONTINUE_PACKET_ACK_F0),					// 0xf0
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_CONTINUE_PACKET_ACK_F1),					// 0xf1
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_SUM_ERROR_BURNING_FLASH),					// 0xf2
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_PACKET_FLAG_ERROR_BURNING_FLASH),			// 0xf3
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_PACKET_LENGTH_ERROR_BURNING_FLASH),		// 0xf4
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_CODE_LENGTH_TOO_LONG_BURNING_FLASH),		// 0xf5
+	static_cast<byte>(AS108M_RESPONSE_CODES::AS108M_BURNING_FLASH_FAILED),						// 0xf6
+};
+
+// Baudrates the reader supports, fastest first
+static const byte baudrateTable[] PROGMEM =
+{
+	static_cast<byte>(AS108M_BAUDRATE::AS108M_115200),
+	static_cast<byte>(AS108M_BAUDRATE::AS108M_57600),
+	static_cast<byte>(AS108M_BAUDRATE::AS108M_38400),
+	static_cast<byte>(AS108M_BAUDRATE::AS108M_19200),
+	static_cast<byte>(AS108M_BAUDRATE::AS108M_9600),
+};
+
+// Default reply timeouts in msec, as instruction / timeout pairs.
+// Register and table reads answer right away, their timeouts only leave room for the reply to come in at 9600 baud.
+// Flash writes and searching the whole database take the longest.
+static const uint16_t commandTimeoutTable[][2] PROGMEM =
+{
+	{ AS108M_GET_IMAGE,				1000 },
+	{ AS108M_GET_CHAR,				1000 },
+	{ AS108M_MATCH,					500 },
+	{ AS108M_SEARCH,				8000 },
+	{ AS108M_REG_MODEL,				1000 },
+	{ AS108M_STORE_CHAR,			3000 },
+	{ AS108M_LOAD_CHAR,				500 },
+	{ AS108M_DELETE_CHAR,			3000 },
+	{ AS108M_EMPTY,					10000 },
+	{ AS108M_WRITE_REG,				500 },
+	{ AS108M_READ_SYS_PARAMETER,	80 },
+	{ AS108M_SET_CHIP_ADDRESS,		1000 },
+	{ AS108M_WRITE_NOTEPAD,			1000 },
+	{ AS108M_READ_NOTEPAD,			80 },
+	{ AS108M_VALID_TEMPLATE_NUM,	50 },
+	{ AS108M_READ_INDEX_TABLE,		80 },
+	{ AS108M_CANCEL,				50 },
+};
+
+// Instructions with latency statistics of their own, in the order of AS108M_INSTRUMENTATION::commands
+static const byte instrumentedCommandTable[AS108M_INSTRUMENTED_COMMANDS - 1] PROGMEM =
+{
+	AS108M_GET_IMAGE,
+	AS108M_GET_CHAR,
+	AS108M_MATCH,
+	AS108M_SEARCH,
+	AS108M_REG_MODEL,
+	AS108M_STORE_CHAR,
+	AS108M_LOAD_CHAR,
+	AS108M_UP_CHAR,
+	AS108M_DOWN_CHAR,
+	AS108M_UP_IMAGE,
+	AS108M_DELETE_CHAR,
+	AS108M_EMPTY,
+	AS108M_WRITE_REG,
+	AS108M_READ_SYS_PARAMETER,
+};
+
+// Upper latency limits in msec of the histogram buckets but the last one
+static const uint16_t latencyBucketTable[AS108M_LATENCY_BUCKETS - 1] PROGMEM =
+{
+	10, 50, 100, 250, 500, 1000, 2500,
+};
+
 bool AS108M::begin(Stream& commPort, uint32_t address, void(*callBack)(void))
 {
 	_comm = &commPort;
 	_address = static_cast<uint32_t>(address);
+	_sysParamsValid = false;
+	_indexTableValid = false;
 	if(callBack != NULL)
 		pCallback = callBack;
 
 	return isConnected();
 }
 
-bool AS108M::isConnected()
+bool AS108M::isConnected(unsigned int timeout)
 {
 	// Clear response
 	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
 	
 	// clear any leftover data that may be in _comm 
 	// since AS108M will send 0x55 after power up
-	while(_comm->available() > 0)
-		_comm->read();
+	discardLateReplies();
 	
 	// Send CANCEL command and wait for reply
 	sendSingleByteCommand(AS108M_CANCEL);
 	
 	// Get data back
-	readPacket();
+	readPacket(timeout);
 	
 	// return if we got an OK from A108M
 	return (response == AS108M_RESPONSE_CODES::AS108M_OK);
@@ -60,1568 +168,2093 @@ void AS108M::sendSingleByteCommand(const byte command)
 void AS108M::sendPacket(const byte* data, byte dataSize)
 {
 	uint16_t checkSum = 0;
-	
-	// packet has 2 header bytes, 4 address bytes and 2 checksum byte
-	byte packetLength = dataSize + 8;
 
 	// checkSum *may* overflow. According to AS108M datasheet:
 	// Sum is the total bytes from packet flag to Sum, the carry will be ignored if it exceed 2 bytes;
 	for(byte i = 0 ; i < dataSize ; i++)
 		checkSum += data[i];
-		
-	// Allocate packet array
-	byte* packet = new byte[packetLength];
-
-	// Assemble and transmit packet
-	packet[0] = 0xef;
-	packet[1] = 0x01;
-	packet[2] = _address >> 24;
-	packet[3] = _address >> 16;
-	packet[4] = _address >> 8;
-	packet[5] = static_cast<byte>(_address & 0xff);
-	
-	for (byte i = 0; i < dataSize; i++)
-		packet[6 + i] = data[i];
-		
-	packet[packetLength - 2] = checkSum >> 8;
-	packet[packetLength - 1] = checkSum & 0x00ff;
-		
-	_comm->write(packet, packetLength);
-	
-	// Delete the array from the heap...
-	delete[] packet;
-	
-	// .. and nullify the pointer
-	packet = NULL;
+
+	// Packet has 2 header bytes, 4 address bytes, the user payload and 2 checksum bytes.
+	// The payload is written straight from the caller's array so no packet is assembled on the heap.
+	const byte header[6] = { 0xef, 0x01, static_cast<byte>(_address >> 24), static_cast<byte>(_address >> 16), static_cast<byte>(_address >> 8), static_cast<byte>(_address & 0xff) };
+	const byte sum[2] = { static_cast<byte>(checkSum >> 8), static_cast<byte>(checkSum & 0x00ff) };
+
+	_comm->write(header, 6);
+	_comm->write(data, dataSize);
+	_comm->write(sum, 2);
+	instrumentSent(6 + dataSize + 2);
+
+	// The reply to a command is waited for as long as that command may take
+	if (data[0] == AS108M_FLAG_COMMAND)
+	{
+		_commandTimeout = getCommandTimeout(data[3]);
+		_commandSent = data[3];
+		_commandSentAt = millis();
+		_commandAwaitingReply = true;
+		instrumentCommand(data[3]);
+	}
 }
 
-AS108M_PACKET_DATA AS108M::readPacket(unsigned int timeout)
+byte AS108M::receiveByte()
+{
+	instrumentReceived();
+	return static_cast<byte>(_comm->read());
+}
+
+void AS108M::sleep(unsigned long ms)
+{
+	instrumentSleep(ms);
+	delay(ms);
+}
+
+unsigned int AS108M::getCommandTimeout(byte command)
+{
+	for (byte i = 0; i < _timeoutOverrideCount; i++)
+	{
+		if (_timeoutOverrides[i].command == command)
+			return _timeoutOverrides[i].timeout;
+	}
+
+	return defaultCommandTimeout(command);
+}
+
+unsigned int AS108M::defaultCommandTimeout(byte command)
+{
+	for (byte i = 0; i < sizeof(commandTimeoutTable) / sizeof(commandTimeoutTable[0]); i++)
+	{
+		if (pgm_read_word(&commandTimeoutTable[i][0]) == command)
+			return pgm_read_word(&commandTimeoutTable[i][1]);
+	}
+
+	return AS108M_DEFAULT_COMMAND_TIMEOUT;
+}
+
+bool AS108M::setCommandTimeout(byte command, unsigned int timeout)
+{
+	for (byte i = 0; i < _timeoutOverrideCount; i++)
+	{
+		if (_timeoutOverrides[i].command != command)
+			continue;
+
+		// Zero restores the default, keep the overrides packed
+		if (timeout == 0)
+			_timeoutOverrides[i] = _timeoutOverrides[--_timeoutOverrideCount];
+		else
+			_timeoutOverrides[i].timeout = timeout;
+
+		return true;
+	}
+
+	if (timeout == 0)
+		return true;
+
+	if (_timeoutOverrideCount >= AS108M_MAX_TIMEOUT_OVERRIDES)
+		return false;
+
+	_timeoutOverrides[_timeoutOverrideCount].command = command;
+	_timeoutOverrides[_timeoutOverrideCount].timeout = timeout;
+	_timeoutOverrideCount++;
+
+	return true;
+}
+
+unsigned int AS108M::replyTimeout()
+{
+	// A timeout set in the retry policy applies to every command
+	return _retryPolicy.timeout != 0 ? _retryPolicy.timeout : _commandTimeout;
+}
+
+const AS108M_PACKET_DATA& AS108M::readPacket(unsigned int timeout)
 {
-	byte tempByte;
-	uint16_t calculatedCheckSum = 0;
-	uint16_t packetLength = 0;
-	byte buffer[45] = { 0 };
-	byte bufferIndex = 0;
-	AS108M_PACKET_DATA reply;
-	
 	// Set response as no response
 	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-		
-	// Wait until we have nothing in the serial port
-	// But time out after timeout msec have elapsed with an empty buffer
+
+	if (timeout == 0)
+		timeout = replyTimeout();
+
+	// Start hunting for a new packet header
+	resetReceiver();
+
+	// Feed every byte to the packet parser as soon as it arrives and return the moment
+	// the last checksum byte is parsed. Time out if no complete packet arrives within timeout msec
 	uint32_t start = millis();
-	while (_comm->available() == 0)
+	while (true)
 	{
+		while (_comm->available() > 0)
+		{
+			if (parseByte(receiveByte()))
+			{
+				_commandAwaitingReply = false;
+				instrumentReply();
+				return _rxPacket;
+			}
+		}
+
 		if (millis() - start > timeout)
 		{
 			response = AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT;
-			return reply;
-		} 
+			instrumentTimeout();
+			if (_commandAwaitingReply)
+				noteLateReply();
+
+			// Do not hand out a partially received packet
+			_rxPacket = AS108M_PACKET_DATA();
+			return _rxPacket;
+		}
 	}
-	
-	// Wait until completed packets arrive - needed for slow operation...
-	delay(50);
-	
-	// Read the whole buffer into buffer array
-	while(_comm->available() > 0)
-	{
-		buffer[bufferIndex] = (byte)_comm->read();
-		bufferIndex++;
-	}	
-	
-	// Do we have a valid header ?
-	if(buffer[0] != 0xEF && buffer[1] == 0x01)
+}
+
+void AS108M::noteLateReply()
+{
+	_commandAwaitingReply = false;
+
+	// A command given less time than the reader may take can still be answered, the reply is lost only after that
+	unsigned int maxTime = getCommandTimeout(_commandSent);
+	if (defaultCommandTimeout(_commandSent) > maxTime)
+		maxTime = defaultCommandTimeout(_commandSent);
+
+	uint32_t deadline = _commandSentAt + maxTime;
+	if (static_cast<int32_t>(deadline - millis()) <= 0)
+		return;
+
+	if (_lateReplies == 0 || static_cast<int32_t>(deadline - _lateDeadline) > 0)
+		_lateDeadline = deadline;
+	if (_lateReplies < 0xff)
+		_lateReplies++;
+	_lateCommand = _commandSent;
+}
+
+void AS108M::discardInput()
+{
+	// Readers sharing their port get their packets from the manager, the others parse the port themselves
+	if (_manager != NULL)
 	{
-		response = AS108M_RESPONSE_CODES::AS108M_INVALID_RESPONSE;
-		return reply;
+		_manager->routePackets();
+		while (_manager->popPacket(*this) != NULL)
+		{
+			if (_lateReplies > 0)
+				_lateReplies--;
+		}
+		return;
 	}
-		
-	// Check if address matches the one programmed
-	uint32_t receivedAddress = static_cast<uint32_t>(buffer[2]) << 24 | static_cast<uint32_t>(buffer[3]) << 16 | static_cast<uint32_t>(buffer[4]) << 8 | static_cast<uint32_t>(buffer[5]);
-	_addressReplied = receivedAddress;
-	if (receivedAddress != _address)
+
+	resetReceiver();
+	while (_comm->available() > 0)
 	{
-		response = AS108M_RESPONSE_CODES::AS108M_ADDRESS_MISMATCH;
-		return reply;
+		if (!parseByte(receiveByte()))
+			continue;
+
+		if (_rxPacket.flagType == FLAG_TYPE::ACK && _lateReplies > 0)
+			_lateReplies--;
+		resetReceiver();
 	}
 
-	// Get current FLAG. Do not forget to sum bytes for checksum calculation !
-	tempByte = buffer[6];
-	calculatedCheckSum += tempByte;
-	switch (tempByte)
+	// The start of a packet still coming in is dropped, the rest of it will be skipped as noise
+	_rxDiscarded += _rxIndex;
+	resetReceiver();
+}
+
+bool AS108M::expectLateReplies()
+{
+	if (_lateReplies > 0 && static_cast<int32_t>(_lateDeadline - millis()) > 0)
+		return true;
+
+	_lateReplies = 0;
+	return false;
+}
+
+unsigned int AS108M::sendSyncCommand()
+{
+	// Reading the system parameters gets a reply longer than any other, unless that's what was late
+	if (_lateCommand == AS108M_READ_SYS_PARAMETER)
 	{
-	case 0x01:
-		reply.flagType = FLAG_TYPE::COMMAND;
-		break;
-			
-	case 0x02:
-		reply.flagType = FLAG_TYPE::DATA;
-		break;
-			
-	case 0x07:
-		reply.flagType = FLAG_TYPE::ACK;	
-		break;
-			
-	case 0x08:
-		reply.flagType = FLAG_TYPE::END;
-		break;
-			
-	default:
-		reply.flagType = FLAG_TYPE::INDETERMINATE;
-		break;
+		_syncCommand = AS108M_READ_INDEX_TABLE;
+		const byte readIndexCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_READ_INDEX_TABLE, 0x00 };
+		sendPacket(readIndexCommand, 5);
 	}
-	
-	if (reply.flagType == FLAG_TYPE::INDETERMINATE)
-		return reply;
-		
-	
-	// Get packet size. Do not forget to sum bytes for checksum calculation !
-	// 2 is subtracted from packetLength since checksum is not part of data itself
-	packetLength = buffer[7] << 8 | buffer[8];
-	packetLength -= 2;
-	calculatedCheckSum += buffer[7];
-	calculatedCheckSum += buffer[8];
-	
-	// Copy all useful payload to reply struct
-	for(byte i = 0 ; i < packetLength ; i++)
+	else
 	{
-		reply.packetData[i] = buffer[i + 9];
-		calculatedCheckSum += buffer[i + 9];
+		_syncCommand = AS108M_READ_SYS_PARAMETER;
+		sendSingleByteCommand(AS108M_READ_SYS_PARAMETER);
 	}
 
-	// Compare checksum and set reponse accordingly
-	uint16_t receivedChecksum = buffer[9 + packetLength] << 8 | buffer[10 + packetLength];
-	response = (receivedChecksum != calculatedCheckSum) ? AS108M_RESPONSE_CODES::AS108M_BAD_CHECKSUM : AS108M_RESPONSE_CODES::AS108M_OK;
-	return reply;
+	// The late replies come first, so the reader may take until they're all due plus the time for this one
+	return (_lateDeadline - millis()) + getCommandTimeout(_syncCommand);
 }
 
-AS108M_RESPONSE_CODES AS108M::getResponseCode(byte response)
+bool AS108M::isSyncReply(const AS108M_PACKET_DATA& reply)
 {
-	if (response == 0x0)
-		return AS108M_RESPONSE_CODES::AS108M_OK;
-
-	if (response == 0x01)
-		return AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
+	byte size = (_syncCommand == AS108M_READ_SYS_PARAMETER) ? AS108M_SYS_PARAMETER_REPLY_SIZE : AS108M_INDEX_TABLE_REPLY_SIZE;
+	return reply.flagType == FLAG_TYPE::ACK && reply.packetLength == size;
+}
 
-	if (response == 0x02)
-		return AS108M_RESPONSE_CODES::AS108M_NO_FINGER;
+void AS108M::discardLateReplies()
+{
+	discardInput();
+	if (!expectLateReplies())
+		return;
 
-	if (response == 0x03)
-		return AS108M_RESPONSE_CODES::AS108M_GET_FINGERPRINT_IMAGE_FAILED;
+	uint32_t start = millis();
+	unsigned int timeout = sendSyncCommand();
+	while (millis() - start < timeout)
+	{
+		const AS108M_PACKET_DATA& reply = readPacket(timeout - (millis() - start));
+		if (response == AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT || isSyncReply(reply))
+			break;
+	}
 
-	if (response == 0x04)
-		return AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_DRY_TOO_LIGHT;
+	// Whatever did not come in by now never will
+	_lateReplies = 0;
+}
 
-	if (response == 0x05)
-		return AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_HUMID_TOO_BLURRY;
+void AS108M::resetReceiver()
+{
+	_rxField = PACKET_FIELD::HEADER;
+	_rxIndex = 0;
+	_rxAddress = 0;
+	_rxLength = 0;
+	_rxCheckSum = 0;
+	_rxReceivedCheckSum = 0;
+	_rxToSink = false;
+	_rxPacket = AS108M_PACKET_DATA();
+}
 
-	if (response == 0x06)
-		return AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_AMORPHOUS;
+bool AS108M::parseByte(byte data)
+{
+	switch (_rxField)
+	{
+	case PACKET_FIELD::HEADER:
+		// Header is 0xEF followed by 0x01. Anything else restarts the header search
+		if (_rxIndex == 1 && data == 0x01)
+		{
+			_rxField = PACKET_FIELD::ADDRESS;
+			_rxIndex = 0;
+		}
+		else
+		{
+			// A lone 0xEF is discarded once the byte after it turns out not to be 0x01
+			_rxDiscarded += _rxIndex;
+			if (data == 0xEF)
+				_rxIndex = 1;
+			else
+			{
+				_rxIndex = 0;
+				_rxDiscarded++;
+			}
+		}
+		break;
 
-	if (response == 0x07)
-		return AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_LITTLE_MINUTIAES;
+	case PACKET_FIELD::ADDRESS:
+		// Address is sent MSB first
+		_rxAddress = (_rxAddress << 8) | data;
+		if (++_rxIndex == 4)
+		{
+			_rxField = PACKET_FIELD::FLAG;
+			_rxIndex = 0;
+		}
+		break;
 
-	if (response == 0x08)
-		return AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_UNMATCHED;
+	case PACKET_FIELD::FLAG:
+		// Get current FLAG. Do not forget to sum bytes for checksum calculation !
+		_rxCheckSum = data;
+		switch (data)
+		{
+		case AS108M_FLAG_COMMAND:
+			_rxPacket.flagType = FLAG_TYPE::COMMAND;
+			break;
 
-	if (response == 0x09)
-		return AS108M_RESPONSE_CODES::AS108M_NO_FINGERPRINT_FOUND;
+		case AS108M_FLAG_DATA:
+			_rxPacket.flagType = FLAG_TYPE::DATA;
+			break;
 
-	if (response == 0x0a)
-		return AS108M_RESPONSE_CODES::AS108M_MERGING_FAILED;
+		case AS108M_FLAG_ACK:
+			_rxPacket.flagType = FLAG_TYPE::ACK;
+			break;
 
-	if (response == 0x0b)
-		return AS108M_RESPONSE_CODES::AS108M_ADDRESS_EXCEEDING_DATABASE_LIMIT;
+		case AS108M_FLAG_END:
+			_rxPacket.flagType = FLAG_TYPE::END;
+			break;
 
-	if (response == 0x0c)
-		return AS108M_RESPONSE_CODES::AS108M_TEMPLATE_READING_ERROR_INVALID_TEMPLATE;
+		default:
+			// Not a packet after all, the header was noise. Drop it and hunt again from this byte
+			return resync(data);
+		}
 
-	if (response == 0x0d)
-		return AS108M_RESPONSE_CODES::AS108M_FEATURE_UPLOAD_FAILED;
+		// Data being transferred goes to the sink, if there's one
+		_rxToSink = (_rxSink != NULL) && (_rxPacket.flagType == FLAG_TYPE::DATA || _rxPacket.flagType == FLAG_TYPE::END);
+		_rxField = PACKET_FIELD::LENGTH;
+		break;
 
-	if (response == 0x0e)
-		return AS108M_RESPONSE_CODES::AS108M_CANNOT_RECEIVE_CONTINUOUS_PACKETS;
+	case PACKET_FIELD::LENGTH:
+		// Packet length is sent MSB first and includes the two checksum bytes
+		_rxLength = (_rxLength << 8) | data;
+		_rxCheckSum += data;
+		if (++_rxIndex == 2)
+		{
+			// Refuse packets that would not fit into packetData or are larger than any data packet
+			uint16_t maxPayload = _rxToSink ? AS108M_MAX_DATA_PACKET_SIZE : sizeof(_rxPacket.packetData);
+			if (_rxLength < 2 || _rxLength - 2U > maxPayload)
+				return resync(data);
+
+			_rxPacket.packetLength = _rxLength - 2;
+			_rxField = (_rxPacket.packetLength > 0) ? PACKET_FIELD::PARAMETER : PACKET_FIELD::CHECKSUM;
+			_rxIndex = 0;
+		}
+		break;
 
-	if (response == 0x0f)
-		return AS108M_RESPONSE_CODES::AS108M_IMAGE_UPLOADING_FAILED;
+	case PACKET_FIELD::PARAMETER:
+		// Copy useful payload straight into the reply struct or the sink
+		if (_rxToSink)
+			_rxSink->write(data);
+		else
+			_rxPacket.packetData[_rxIndex] = data;
+		_rxCheckSum += data;
+		if (++_rxIndex == _rxPacket.packetLength)
+		{
+			_rxField = PACKET_FIELD::CHECKSUM;
+			_rxIndex = 0;
+		}
+		break;
 
-	if (response == 0x10)
-		return AS108M_RESPONSE_CODES::AS108M_IMAGE_DELETING_FAILED;
+	case PACKET_FIELD::CHECKSUM:
+		_rxReceivedCheckSum = (_rxReceivedCheckSum << 8) | data;
+		if (++_rxIndex == 2)
+		{
+			// This is useful when trying to blindly get the reader's address
+			if (!_rxRouting)
+				_addressReplied = _rxAddress;
+
+			// Check if address matches the one programmed, then compare checksum and set reponse accordingly.
+			// Packets read on behalf of every reader on a shared port are sorted out by the manager instead
+			if (_rxAddress != _address && !_rxRouting)
+				response = AS108M_RESPONSE_CODES::AS108M_ADDRESS_MISMATCH;
+			else if (_rxReceivedCheckSum != _rxCheckSum)
+			{
+				// A torn packet may have swallowed the start of the real one
+				if (!_rxToSink && !_rxReplaying && replayAfterBadChecksum())
+					return _rxField == PACKET_FIELD::INVALID;
 
-	if (response == 0x11)
-		return AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_DATABASE_CLEAR_FAILED;
+				response = AS108M_RESPONSE_CODES::AS108M_BAD_CHECKSUM;
+				instrumentChecksumError();
+			}
+			else
+				response = AS108M_RESPONSE_CODES::AS108M_OK;
 
-	if (response == 0x12)
-		return AS108M_RESPONSE_CODES::AS108M_CANNOT_IN_LOW_POWER_CONSUMPTION;
+			_rxField = PACKET_FIELD::INVALID;
+			return true;
+		}
+		break;
 
-	if (response == 0x13)
-		return AS108M_RESPONSE_CODES::AS108M_INVALID_PASSWORD;
+	default:
+		// A packet was already completed or rejected - ignore anything until the receiver is reset
+		break;
+	}
 
-	if (response == 0x14)
-		return AS108M_RESPONSE_CODES::AS108M_SYSTEM_RESET_FAILED;
+	return false;
+}
 
-	if (response == 0x15)
-		return AS108M_RESPONSE_CODES::AS108M_NO_VALID_ORIGINAL_IMAGE_ON_BUFFER;
+bool AS108M::resync(byte data)
+{
+	// Bytes received after the header that turned out to be noise, up to this one
+	byte received[4 + 1 + 2];
+	byte receivedSize = saveReceived(received);
+	received[receivedSize++] = data;
 
-	if (response == 0x16)
-		return AS108M_RESPONSE_CODES::AS108M_ONLINE_UPGRADING_FAILED;
+	// The real packet may start anywhere in there
+	return replay(received, receivedSize, findHeader(received, receivedSize));
+}
 
-	if (response == 0x17)
-		return AS108M_RESPONSE_CODES::AS108M_INCOMPLETE_OR_STILL_FINGERPRINT;
+bool AS108M::replayAfterBadChecksum()
+{
+	// Bytes received after the header, checksum included
+	byte received[4 + 1 + 2 + sizeof(_rxPacket.packetData) + 2];
+	byte receivedSize = saveReceived(received);
+	received[receivedSize++] = _rxReceivedCheckSum >> 8;
+	received[receivedSize++] = _rxReceivedCheckSum & 0xff;
+
+	// Only worth it if another header starts in there, otherwise this really was a corrupted packet
+	byte start = findHeader(received, receivedSize);
+	if (start == receivedSize)
+		return false;
 
-	if (response == 0x18)
-		return AS108M_RESPONSE_CODES::AS108M_FLASH_READ_WRITE_ERROR;
+	replay(received, receivedSize, start);
+	return true;
+}
 
-	if (response == 0x19)
-		return AS108M_RESPONSE_CODES::AS108M_UNDEFINED_ERROR;
+byte AS108M::saveReceived(byte* received)
+{
+	byte receivedSize = 0;
+	for (int8_t shift = 24; shift >= 0; shift -= 8)
+		received[receivedSize++] = _rxAddress >> shift;
 
-	if (response == 0x1a)
-		return AS108M_RESPONSE_CODES::AS108M_INVALID_REGISTER;
+	if (_rxField == PACKET_FIELD::FLAG)
+		return receivedSize;
 
-	if (response == 0x1b)
-		return AS108M_RESPONSE_CODES::AS108M_REGISTER_DISTRIBUTING_CONTENT_WRONG_NUMBER;
+	const byte flags[] = { 0x00, AS108M_FLAG_COMMAND, AS108M_FLAG_DATA, AS108M_FLAG_ACK, AS108M_FLAG_END };
+	received[receivedSize++] = flags[static_cast<byte>(_rxPacket.flagType)];
 
-	if (response == 0x1c)
-		return AS108M_RESPONSE_CODES::AS108M_NOTEPAD_PAGE_APPOINTING_ERROR;
+	// The last length byte is the one being parsed right now
+	if (_rxField == PACKET_FIELD::LENGTH)
+	{
+		received[receivedSize++] = _rxLength >> 8;
+		return receivedSize;
+	}
 
-	if (response == 0x1d)
-		return AS108M_RESPONSE_CODES::AS108M_PORT_OPERATION_FAILED;
+	received[receivedSize++] = _rxLength >> 8;
+	received[receivedSize++] = _rxLength & 0xff;
+	for (uint16_t i = 0; i < _rxPacket.packetLength; i++)
+		received[receivedSize++] = _rxPacket.packetData[i];
 
-	if (response == 0x1e)
-		return AS108M_RESPONSE_CODES::AS108M_AUTOMATIC_ENROLL_FAILED;
+	return receivedSize;
+}
 
-	if (response == 0x1f)
-		return AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_DATABASE_FULL;
+byte AS108M::findHeader(const byte* received, byte receivedSize)
+{
+	// A trailing 0xEF may be followed by 0x01 in the bytes still to come
+	byte start = 0;
+	while (start < receivedSize && !(received[start] == 0xEF && (start + 1 == receivedSize || received[start + 1] == 0x01)))
+		start++;
 
-	if (response == 0x21)
-		return AS108M_RESPONSE_CODES::AS108M_MUST_VERIFY_PASSWORD;
+	return start;
+}
 
-	if (response == 0xf0)
-		return AS108M_RESPONSE_CODES::AS108M_CONTINUE_PACKET_ACK_F0;
+bool AS108M::replay(const byte* received, byte receivedSize, byte start)
+{
+	// The header and everything before start was not a packet
+	_rxDiscarded += 2 + start;
+	resetReceiver();
 
-	if (response == 0xf1)
-		return AS108M_RESPONSE_CODES::AS108M_CONTINUE_PACKET_ACK_F1;
+	// Replayed bytes are not replayed again if they fail too, which bounds the stack used
+	if (_rxReplaying)
+	{
+		_rxDiscarded += receivedSize - start;
+		return false;
+	}
 
-	if (response == 0xf2)
-		return AS108M_RESPONSE_CODES::AS108M_SUM_ERROR_BURNING_FLASH;
+	bool complete = false;
+	_rxReplaying = true;
+	for (byte i = start; i < receivedSize && !complete; i++)
+		complete = parseByte(received[i]);
+	_rxReplaying = false;
 
-	if (response == 0xf3)
-		return AS108M_RESPONSE_CODES::AS108M_PACKET_FLAG_ERROR_BURNING_FLASH;
+	return complete;
+}
 
-	if (response == 0xf4)
-		return AS108M_RESPONSE_CODES::AS108M_PACKET_LENGTH_ERROR_BURNING_FLASH;
+uint32_t AS108M::getDiscardedBytes()
+{
+	return _rxDiscarded;
+}
 
-	if (response == 0xf5)
-		return AS108M_RESPONSE_CODES::AS108M_CODE_LENGTH_TOO_LONG_BURNING_FLASH;
+AS108M_RESPONSE_CODES AS108M::getResponseCode(byte response)
+{
+	// Confirm codes 0x00 to 0x21 index the table directly
+	if (response <= 0x21)
+		return static_cast<AS108M_RESPONSE_CODES>(pgm_read_byte(&confirmCodeTable[response]));
 
-	if (response == 0xf6)
-		return AS108M_RESPONSE_CODES::AS108M_BURNING_FLASH_FAILED;
+	// Flash burning codes 0xf0 to 0xf6 are stored right after them
+	if (response >= 0xf0 && response <= 0xf6)
+		return static_cast<AS108M_RESPONSE_CODES>(pgm_read_byte(&confirmCodeTable[0x22 + response - 0xf0]));
 
-	if ((response == 0x20) || (response > 0x21 && response <= 0xef))
+	if (response <= 0xef)
 		return AS108M_RESPONSE_CODES::AS108M_RESERVED;
 
 	return AS108M_RESPONSE_CODES::AS108M_INVALID_RESPONSE;
 }
 
-AS108M_QUERY_DATA AS108M::searchFingerprint()
-{	
-	// Set response as no response
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
-	
-	// Create default searchData struct (no finger detected)
-	AS108M_QUERY_DATA searchData;
-	
-	// Searching is composed of three steps:
-	// 1) Read Fingerprint using PS_GetImage
-	// 2) Generate the image into a specific BufferID (1 in this case)
-	// 3) Search the chip's memory for a fingerprint match
-	
-	// exit flag
-	bool exit = false;
-	
-	do
+void AS108M::exchangeCommand(const byte* command, byte commandSize, bool retry)
+{
+	byte maxAttempts = retry ? _retryPolicy.maxAttempts : 1;
+
+	for (byte attempt = 1; ; attempt++)
 	{
-		sendSingleByteCommand(AS108M_GET_IMAGE);
-		reply = readPacket();
-		
-		// If readPacket() did not set AS108M_OK return searchData as is
-		if(response != AS108M_RESPONSE_CODES::AS108M_OK)
-			return searchData;
-		
-		// We have a valid reply packet, so let's see if there's a finger in the sensor.
-		
-		switch(reply.packetData[0])
-		{
-		case 0x0:
-			{
-				exit = true;
-			}
-			break;
+		// A reply to an earlier attempt or command that comes in late must not be taken for this one
+		discardLateReplies();
+		sendPacket(command, commandSize);
 
-		case 0x01:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-				
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return searchData;
-			}
-			break;
+		// Get the reply from the device
+		const AS108M_PACKET_DATA& reply = readPacket();
 
-		case 0x02:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_NO_FINGER;
-				if (pCallback != NULL)
-					pCallback();
-				return searchData;
-			}
+		// If readPacket() set AS108M_OK the confirm code tells how the command went
+		if (response == AS108M_RESPONSE_CODES::AS108M_OK)
+			response = getResponseCode(reply.packetData[0]);
+
+		if (!isTransientFailure(response))
+		{
+			if (attempt > 1)
+				_retryStats.recovered++;
 			break;
-			
-		case 0x03:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_GET_FINGERPRINT_IMAGE_FAILED;
+		}
 
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return searchData;
-			}
+		if (attempt >= maxAttempts)
+		{
+			if (attempt > 1)
+				_retryStats.exhausted++;
 			break;
+		}
 
-		default:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+		// Only this command is sent again, whatever the previous ones left in the reader's buffers is still there
+		_retryStats.retries++;
+		sleep(retryBackoff(attempt));
+	}
+}
 
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return searchData;
-			}
-			break;
+uint16_t AS108M::retryBackoff(byte attempt)
+{
+	// Doubled for every attempt after the first, without going past the maximum or overflowing
+	uint16_t backoff = _retryPolicy.backoff;
+	for (byte i = 1; i < attempt && backoff < AS108M_MAX_RETRY_BACKOFF; i++)
+		backoff = (backoff < AS108M_MAX_RETRY_BACKOFF / 2) ? backoff * 2 : AS108M_MAX_RETRY_BACKOFF;
+	return backoff;
+}
 
-		}
-	} while (!exit) ;
-	
-	// If we got this far it means we have a valid fingerprint in the scanner. Generate the char buffer...
-	
-	// Create and send command to genetrate CharBuffer to BufferID 1
-	byte genCharBufCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_GET_CHAR, AS108M_BUFFER_ID_1 };
-	sendPacket(genCharBufCommand, 5);
-	
-	// Empty the previously used reply struct
-	memset(&reply, 0, sizeof(reply));
-	
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	// If readPacket() did not set AS108M_OK return searchData as is
-	if(response != AS108M_RESPONSE_CODES::AS108M_OK)
+bool AS108M::sendCommand(const byte* command, byte commandSize, bool retry)
+{
+	exchangeCommand(command, commandSize, retry);
+
+	if (response != AS108M_RESPONSE_CODES::AS108M_OK)
 	{
 		// Callback the function passed if it's not NULL
-		if(pCallback != NULL)
+		if (pCallback != NULL)
 			pCallback();
-				
-		return searchData;
+
+		return false;
 	}
-	
-	// Parse confirm code returned
-	switch(reply.packetData[0])
-	{
-	
-	case 0x0:
-		// No errors, just exit the switch
-		break;
-		
-	case 0x01:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	case 0x06:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_AMORPHOUS;
+	return true;
+}
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	case 0x07:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_LITTLE_MINUTIAES;
+bool AS108M::readReply()
+{
+	const AS108M_PACKET_DATA& reply = readPacket();
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	case 0x15:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_NO_VALID_ORIGINAL_IMAGE_ON_BUFFER;
+	if (response == AS108M_RESPONSE_CODES::AS108M_OK)
+		response = getResponseCode(reply.packetData[0]);
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	default:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+	if (response != AS108M_RESPONSE_CODES::AS108M_OK)
+	{
+		// Callback the function passed if it's not NULL
+		if (pCallback != NULL)
+			pCallback();
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
+		return false;
 	}
-	
-	// Final step is to search the device for a matching fingerprint from page 0 to 99
-	byte searchCommand[9] = { AS108M_FLAG_COMMAND, 0x0, 0x08, AS108M_SEARCH, AS108M_BUFFER_ID_1, 0x00, 0x00, 0x00, 0x28 };
-		
-	sendPacket(searchCommand, 9);
 
-	// Empty the previously used reply struct
-	memset(&reply, 0, sizeof(reply));
-	
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	// If readPacket() did not set AS108M_OK return searchData as is
-	if(response != AS108M_RESPONSE_CODES::AS108M_OK)
-		return searchData;
-	
-	switch (reply.packetData[0])
+	return true;
+}
+
+bool AS108M::isTransientFailure(AS108M_RESPONSE_CODES code)
+{
+	// Line noise or a lost packet, the same command is likely to work if sent again
+	return code == AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT || code == AS108M_RESPONSE_CODES::AS108M_BAD_CHECKSUM ||
+		code == AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
+}
+
+void AS108M::setRetryPolicy(AS108M_RETRY_POLICY policy)
+{
+	// At least one attempt is always made
+	if (policy.maxAttempts == 0)
+		policy.maxAttempts = 1;
+
+	_retryPolicy = policy;
+}
+
+AS108M_RETRY_POLICY AS108M::getRetryPolicy()
+{
+	return _retryPolicy;
+}
+
+AS108M_RETRY_STATS AS108M::getRetryStats()
+{
+	return _retryStats;
+}
+
+void AS108M::resetRetryStats()
+{
+	_retryStats = AS108M_RETRY_STATS();
+}
+
+uint16_t AS108M::getSearchPageCount(uint16_t startPage, uint16_t pageCount)
+{
+	if (pageCount != AS108M_SEARCH_AUTO)
+		return pageCount;
+
+	// Search from startPage up to the end of the database...
+	uint16_t databaseSize = readSystemParameters().databaseSize;
+	if (response != AS108M_RESPONSE_CODES::AS108M_OK)
+		return 0;
+
+	// ... but stop right after the last enrolled fingerprint
+	if (!readIndexTable())
+		return 0;
+
+	uint16_t endPage = databaseSize;
+	if (databaseSize <= indexTableCapacity())
 	{
-	case 0x0:
-		{
-			// Fingerprint match was found.
-			searchData.found = true;
-			searchData.pageId = reply.packetData[2];	// ID will never be more than 99 !
-			searchData.matchScore = reply.packetData[3] << 8 | reply.packetData[4];
-		}
-		break;
-		
-	case 0x01:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-			
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-		}
-		break;
-	
-	case 0x09:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_NO_FINGERPRINT_FOUND;
-			
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-		}
-		break;
-		
-	default:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+		while (endPage > 0 && !(indexTable()[(endPage - 1) / 8] & (1 << ((endPage - 1) % 8))))
+			endPage--;
+	}
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-		}
-		break;
+	if (endPage <= startPage)
+	{
+		response = (startPage >= databaseSize) ? AS108M_RESPONSE_CODES::AS108M_ADDRESS_EXCEEDING_DATABASE_LIMIT : AS108M_RESPONSE_CODES::AS108M_NO_FINGERPRINT_FOUND;
+
+		// Callback the function passed if it's not NULL
+		if (pCallback != NULL)
+			pCallback();
+
+		return 0;
 	}
-	
+
+	return endPage - startPage;
+}
+
+AS108M_QUERY_DATA AS108M::searchFingerprint(uint16_t startPage, uint16_t pageCount)
+{
+	const AS108M_PACKET_DATA& reply = _rxPacket;
+
+	// Create default searchData struct (no finger detected)
+	AS108M_QUERY_DATA searchData;
+
+	// Searching is composed of three steps:
+	// 1) Read Fingerprint using PS_GetImage
+	// 2) Generate the image into a specific BufferID (1 in this case)
+	// 3) Search the chip's memory for a fingerprint match
+
+	// Work out the search range first so no finger is read if there is nothing to search
+	pageCount = getSearchPageCount(startPage, pageCount);
+	if (pageCount == 0)
+		return searchData;
+
+	byte getImageCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_GET_IMAGE };
+	if (!sendCommand(getImageCommand, 4))
+		return searchData;
+
+	// If we got this far it means we have a valid fingerprint in the scanner. Generate the char buffer...
+	byte genCharBufCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_GET_CHAR, AS108M_BUFFER_ID_1 };
+	if (!sendCommand(genCharBufCommand, 5))
+		return searchData;
+
+	// Final step is to search the device for a matching fingerprint from startPage on
+	byte searchCommand[9] = { AS108M_FLAG_COMMAND, 0x0, 0x08, AS108M_SEARCH, AS108M_BUFFER_ID_1,
+		static_cast<byte>(startPage >> 8), static_cast<byte>(startPage & 0xff), static_cast<byte>(pageCount >> 8), static_cast<byte>(pageCount & 0xff) };
+	if (!sendCommand(searchCommand, 9))
+		return searchData;
+
+	// Fingerprint match was found.
+	searchData.found = true;
+	searchData.pageId = reply.packetData[1] << 8 | reply.packetData[2];
+	searchData.matchScore = reply.packetData[3] << 8 | reply.packetData[4];
+
 	return searchData;
 }
 
-AS108M_QUERY_DATA AS108M::getFingerprintMatch(byte ID)
+AS108M_QUERY_DATA AS108M::getFingerprintMatch(uint16_t ID)
 {
-	// Set response as no response
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
-	
+	const AS108M_PACKET_DATA& reply = _rxPacket;
+
 	// Create default searchData struct (no finger detected)
 	AS108M_QUERY_DATA searchData;
-	
+
 	// Looking for a match is composed of four steps:
 	// 1) Read Fingerprint using PS_GetImage
 	// 2) Generate the image into a specific BufferID 1
-	// 3) Load fingerprint ID (PageNumber) from the chip memory in BufferID 2 
+	// 3) Load fingerprint ID (PageNumber) from the chip memory in BufferID 2
 	// 4) Call PS_Match
 
-	// exit flag
-	bool exit = false;
+	byte getImageCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_GET_IMAGE };
+	if (!sendCommand(getImageCommand, 4))
+		return searchData;
 
-	do
-	{
-		sendSingleByteCommand(AS108M_GET_IMAGE);
-		reply = readPacket();
-		
-		// If readPacket() did not set AS108M_OK return searchData as is
-		if(response != AS108M_RESPONSE_CODES::AS108M_OK)
-			return searchData;
-		
-		// We have a valid reply packet, so let's see if there's a finger in the sensor.
-		
-		switch(reply.packetData[0])
-		{
-		case 0x0:
-			{
-				exit = true;
-			}
-			break;
+	// Create and send command to genetrate CharBuffer
+	byte genCharBufCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_GET_CHAR, AS108M_BUFFER_ID_1 };
+	if (!sendCommand(genCharBufCommand, 5))
+		return searchData;
 
-		case 0x01:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-				
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return searchData;
-			}
-			break;
+	// Load ID into BufferID 2
+	byte loadCommand[7] = { AS108M_FLAG_COMMAND, 0x0, 0x06, AS108M_LOAD_CHAR, AS108M_BUFFER_ID_2, static_cast<byte>(ID >> 8), static_cast<byte>(ID & 0xff) };
+	if (!sendCommand(loadCommand, 7))
+		return searchData;
 
-		case 0x02:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_NO_FINGER;
+	// Call match function
+	byte matchCommand[4] = { AS108M_FLAG_COMMAND, 0x0, 0x03, AS108M_MATCH };
+	if (!sendCommand(matchCommand, 4))
+		return searchData;
 
-				// Callback the function passed if it's not NULL
-				if (pCallback != NULL)
-					pCallback();
-					
-				return searchData;
-			}
-			break;
-			
-		case 0x03:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_GET_FINGERPRINT_IMAGE_FAILED;
+	// Fingerprint match was found.
+	searchData.found = true;
+	searchData.pageId = ID;
+	searchData.matchScore = reply.packetData[1] << 8 | reply.packetData[2];
 
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return searchData;
-			}
-			break;
+	return searchData;
+}
 
-		default:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+byte AS108M::identifyFingerprint(const uint16_t* candidates, byte candidateCount, AS108M_QUERY_DATA* results, byte resultCount)
+{
+	const AS108M_PACKET_DATA& reply = _rxPacket;
 
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return searchData;
-			}
-			break;
+	// Read the finger once into BufferID 1, it stays there for every match below
+	byte getImageCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_GET_IMAGE };
+	if (!sendCommand(getImageCommand, 4))
+		return 0;
 
-		}
-	} while (!exit) ;
-	
-	// Create and send command to genetrate CharBuffer
 	byte genCharBufCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_GET_CHAR, AS108M_BUFFER_ID_1 };
-	sendPacket(genCharBufCommand, 5);
-	
-	// Empty the previously used reply struct
-	memset(&reply, 0, sizeof(reply));
-	
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	// If readPacket() did not set AS108M_OK return searchData as is
-	if(response != AS108M_RESPONSE_CODES::AS108M_OK)
-	{
-		// Callback the function passed if it's not NULL
-		if(pCallback != NULL)
-			pCallback();
-				
-		return searchData;
-	}
-	
-	// Parse confirm code returned
-	switch(reply.packetData[0])
+	if (!sendCommand(genCharBufCommand, 5))
+		return 0;
+
+	byte ranked = 0;
+	for (byte i = 0; i < candidateCount; i++)
 	{
-	
-	case 0x0:
-		// No errors, just exit the switch
-		break;
-		
-	case 0x01:
+		uint16_t ID = candidates[i];
+		if (isRangeKnownFree(ID, ID + 1))
+			continue;
+
+		// Load the candidate into BufferID 2, an empty page has nothing to match
+		byte loadCommand[7] = { AS108M_FLAG_COMMAND, 0x0, 0x06, AS108M_LOAD_CHAR, AS108M_BUFFER_ID_2, static_cast<byte>(ID >> 8), static_cast<byte>(ID & 0xff) };
+		exchangeCommand(loadCommand, 7);
+		if (response == AS108M_RESPONSE_CODES::AS108M_TEMPLATE_READING_ERROR_INVALID_TEMPLATE)
+			continue;
+
+		// Match it against BufferID 1. A candidate that does not match is no failure here, its score still counts
+		byte matchCommand[4] = { AS108M_FLAG_COMMAND, 0x0, 0x03, AS108M_MATCH };
+		if (response == AS108M_RESPONSE_CODES::AS108M_OK)
+			exchangeCommand(matchCommand, 4);
+
+		if (response != AS108M_RESPONSE_CODES::AS108M_OK && response != AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_UNMATCHED)
 		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
 			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
+			if (pCallback != NULL)
 				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	case 0x06:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_AMORPHOUS;
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
+			return 0;
 		}
-		break;
-		
-	case 0x07:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_LITTLE_MINUTIAES;
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	case 0x15:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_NO_VALID_ORIGINAL_IMAGE_ON_BUFFER;
+		AS108M_QUERY_DATA candidate;
+		candidate.found = response == AS108M_RESPONSE_CODES::AS108M_OK;
+		candidate.pageId = ID;
+		candidate.matchScore = reply.packetData[1] << 8 | reply.packetData[2];
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	default:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+		// Keep the results sorted, a candidate scoring no better than the last one kept is dropped once results is full
+		if (ranked < resultCount)
+			ranked++;
+		else if (resultCount == 0 || candidate.matchScore <= results[ranked - 1].matchScore)
+			continue;
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
+		byte position = ranked - 1;
+		while (position > 0 && results[position - 1].matchScore < candidate.matchScore)
+		{
+			results[position] = results[position - 1];
+			position--;
 		}
-		break;
+		results[position] = candidate;
 	}
-	
-	// Load ID into BufferID 2
-	byte loadCommand[7] = { AS108M_FLAG_COMMAND, 0x0, 0x06, AS108M_LOAD_CHAR, AS108M_BUFFER_ID_2, 0x00, ID };
-		
-	sendPacket(loadCommand, 7);
 
-	// Empty the previously used reply struct
-	memset(&reply, 0, sizeof(reply));
-	
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	switch (reply.packetData[0])
-	{
-	case 0x0:
-		// No errors, just exit the switch
-		break;
-		
-	case 0x01:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	case 0x0b:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_ADDRESS_EXCEEDING_DATABASE_LIMIT;
-			
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;			
-		}
-		break;
-		
-	case 0x0c:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_TEMPLATE_READING_ERROR_INVALID_TEMPLATE;
-			
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-		
-	default:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+	response = AS108M_RESPONSE_CODES::AS108M_OK;
+	return ranked;
+}
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return searchData;
-		}
-		break;
-	}
-	
-	// Call match function
-	byte matchCommand[4] = { AS108M_FLAG_COMMAND, 0x0, 0x03, AS108M_MATCH };
-	
-	sendPacket(matchCommand, 4);
-	
-	// Empty the previously used reply struct
-	memset(&reply, 0, sizeof(reply));
-	
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	// If readPacket() did not set AS108M_OK return searchData as is
-	if(response != AS108M_RESPONSE_CODES::AS108M_OK)
-	return searchData;
-	
-	switch (reply.packetData[0])
+bool AS108M::waitForFinger(bool present)
+{
+	// Poll fast right after the user was prompted and back off while nothing happens
+	uint16_t interval = _fingerPollMinInterval;
+
+	while (true)
 	{
-	case 0x0:
-		{
-			// Fingerprint match was found.
-			searchData.found = true;
-			searchData.pageId = ID;
-			searchData.matchScore = reply.packetData[1] << 8 | reply.packetData[2];
-		}
-		break;
-		
-	case 0x01:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-			
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-		}
-		break;
-	
-	case 0x08:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_UNMATCHED;
-			
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-		}
-		break;
-		
-	default:
+		// The touch-out line is much cheaper to check than GET_IMAGE, so only talk to the reader
+		// once it reports the finger state we are waiting for. Removal needs no confirmation at all
+		if (pTouchCallback == NULL || pTouchCallback() == present)
 		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+			if (!present && pTouchCallback != NULL)
+				return true;
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-		}
-		break;
-	}
-	
-	return searchData;
-	
-}
+			discardLateReplies();
+			sendSingleByteCommand(AS108M_GET_IMAGE);
+			readPacket();
 
-bool AS108M::enrollFingerprint(byte ID, byte numSamples)
-{
-	// Set response as no response
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
-	
+			if (response == AS108M_RESPONSE_CODES::AS108M_OK)
+				response = getResponseCode(_rxPacket.packetData[0]);
+
+			if (present && response == AS108M_RESPONSE_CODES::AS108M_OK)
+				return true;
+
+			if (!present && response == AS108M_RESPONSE_CODES::AS108M_NO_FINGER)
+				return true;
+
+			// Removal is waited for no matter what, but a touch that cannot be read is an error
+			if (present && response != AS108M_RESPONSE_CODES::AS108M_NO_FINGER)
+			{
+				// Callback the function passed if it's not NULL
+				if (pCallback != NULL)
+					pCallback();
+
+				return false;
+			}
+		}
+
+		sleep(interval);
+		interval = (interval * 2 < _fingerPollMaxInterval) ? interval * 2 : _fingerPollMaxInterval;
+	}
+}
+
+void AS108M::setFingerPolling(uint16_t minInterval, uint16_t maxInterval)
+{
+	_fingerPollMinInterval = minInterval;
+	_fingerPollMaxInterval = (maxInterval > minInterval) ? maxInterval : minInterval;
+}
+
+void AS108M::setTouchCallback(bool(*touchCallBack)(void))
+{
+	pTouchCallback = touchCallBack;
+}
+
+bool AS108M::enrollFingerprint(uint16_t ID, byte numSamples)
+{
 	// Enroll a fingerprint consist of looping numSamples times. In each itertion bufferID is incremented and the newly acquired image is stored
 	// in this bufferID. After all iterations are completed a model is generated and stored in flash in position ID.
-	
-	// exit flag
-	bool exit = false;
-	
+	if (!captureModel(numSamples))
+		return false;
+
+	// Save contents into flash at address ID
+	byte saveContentsCommand[7] = { AS108M_FLAG_COMMAND, 0x00, 0x06, AS108M_STORE_CHAR, AS108M_BUFFER_ID_1, static_cast<byte>(ID >> 8), static_cast<byte>(ID & 0xff) };
+	if (!sendCommand(saveContentsCommand, 7))
+		return false;
+
+	setSlotUsed(ID, true);
+	return true;
+}
+
+bool AS108M::captureTemplate(Print& sink, byte numSamples)
+{
+	// Same as enrolling, but the model is handed out instead of being stored
+	if (!captureModel(numSamples))
+		return false;
+
+	return uploadTemplate(sink, AS108M_BUFFER_ID_1);
+}
+
+bool AS108M::captureModel(byte numSamples)
+{
 	for(byte sample = 1 ; sample <= numSamples ; sample++)
 	{
 		response = AS108M_RESPONSE_CODES::AS108M_TOUCH_SENSOR;
 		if (pCallback != NULL)
 			pCallback();
-		response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-		do
-		{
-			sendSingleByteCommand(AS108M_GET_IMAGE);
-			memset(&reply, 0, sizeof(reply));
-			reply.packetData[0] = 0xff;
-			reply = readPacket();
-		
-			// If readPacket() did not set AS108M_OK return searchData as is
-			if(response != AS108M_RESPONSE_CODES::AS108M_OK)
-				return false;
-		
-			// We have a valid reply packet, so let's see if there's a finger in the sensor.		
-			switch(reply.packetData[0])
-			{
-			case 0x0:
-				{
-					exit = true;
-				}
-				break;
-
-			case 0x01:
-				{
-					response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-					// Callback the function passed if it's not NULL
-					if(pCallback != NULL)
-						pCallback();
-				
-					return false;
-				}
-				break;
-
-			case 0x02:
-				{
-					// No finger in sensor, so loop and wait until user touches the sensor...
-					response = AS108M_RESPONSE_CODES::AS108M_NO_FINGER;
-					delay(200);
-				}
-				break;
-			
-			case 0x03:
-				{
-					response = AS108M_RESPONSE_CODES::AS108M_GET_FINGERPRINT_IMAGE_FAILED;
-
-					// Callback the function passed if it's not NULL
-					if(pCallback != NULL)
-						pCallback();
-				
-					return false;
-				}
-				break;
-
-			default:
-				{
-					response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
-
-					// Callback the function passed if it's not NULL
-					if(pCallback != NULL)
-						pCallback();
-				
-					return false;
-				}
-				break;
 
-			}
-		} while (!exit) ;
-	
+		// Wait until user touches the sensor...
+		if (!waitForFinger(true))
+			return false;
+
 		response = AS108M_RESPONSE_CODES::AS108M_REMOVE_FINGER;
 		if (pCallback != NULL)
 			pCallback();
-		
-		// Wait until user remove finger from sensor...
-		do
-		{
-			sendSingleByteCommand(AS108M_GET_IMAGE);
-			memset(&reply, 0, sizeof(reply));
-			reply.packetData[0] = 0xff;
-			reply = readPacket();
-			delay(200);
-		} while (reply.packetData[0] != 0x02);
-
-		exit = false;
-		
+
+		// ... and removes the finger from it
+		waitForFinger(false);
+
 		// Create and send command to genetrate CharBuffer
 		byte genCharBufCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_GET_CHAR, sample };
-		sendPacket(genCharBufCommand, 5);
-	
-		// Empty the previously used reply struct
-		memset(&reply, 0, sizeof(reply));
-		reply.packetData[0] = 0xff;
-		
-		// Set response as no response again
-		response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-		// Get the reply from the device
-		reply = readPacket();
-	
-		// If readPacket() did not set AS108M_OK return searchData as is
-		if(response != AS108M_RESPONSE_CODES::AS108M_OK)
-		{
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
+		if (!sendCommand(genCharBufCommand, 5))
 			return false;
-		}
-	
-		// Parse confirm code returned
-		switch(reply.packetData[0])
-		{
-	
-		case 0x0:
-			// No errors, just exit the switch
-			break;
-		
-		case 0x01:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return false;
-			}
-			break;
-		
-		case 0x06:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_AMORPHOUS;
+	}
 
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return false;
-			}
-			break;
-		
-		case 0x07:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_TOO_LITTLE_MINUTIAES;
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-			
-				return false;
-			}
-			break;
-		
-		case 0x15:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_NO_VALID_ORIGINAL_IMAGE_ON_BUFFER;
+	// Generate model
+	byte genModelCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_REG_MODEL };
+	return sendCommand(genModelCommand, 4);
+}
 
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return false;
-			}
-			break;
-		
-		default:
-			{
-				response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+bool AS108M::clearFingerprintDatabase()
+{
+	byte clearCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_EMPTY };
+	if (!sendCommand(clearCommand, 4))
+		return false;
 
-				// Callback the function passed if it's not NULL
-				if(pCallback != NULL)
-					pCallback();
-				
-				return false;
-			}
-			break;
-		}
+	// The database is known to be empty now
+	memset(indexTable(), 0, _indexTablePages * AS108M_INDEX_TABLE_PAGE_SIZE);
+	_enrolledCount = 0;
+	_indexTableValid = true;
+	return true;
+}
+
+bool AS108M::deleteFingerprintEntry(uint16_t ID)
+{
+	return deleteFingerprintRange(ID, 1);
+}
+
+bool AS108M::deleteFingerprintRange(uint16_t startID, uint16_t count)
+{
+	if (count == 0)
+	{
+		response = AS108M_RESPONSE_CODES::AS108M_OK;
+		return true;
 	}
-	
-	// Generate model
-	byte genModelCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_REG_MODEL };
-	sendPacket(genModelCommand, 4);
-	
-	// Empty the previously used reply struct
-	memset(&reply, 0, sizeof(reply));
-	reply.packetData[0] = 0xff;
-	
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	// Do we have a successful merge ?
-	switch(reply.packetData[0])
+
+	byte deleteCommand[8] = { AS108M_FLAG_COMMAND, 0x00, 0x07, AS108M_DELETE_CHAR, static_cast<byte>(startID >> 8), static_cast<byte>(startID & 0xff),
+		static_cast<byte>(count >> 8), static_cast<byte>(count & 0xff) };
+	if (!sendCommand(deleteCommand, 8))
+		return false;
+
+	for (uint16_t ID = startID; ID - startID < count && ID < indexTableCapacity(); ID++)
+		setSlotUsed(ID, false);
+
+	return true;
+}
+
+bool AS108M::deleteFingerprintEntries(const uint16_t* IDs, byte count)
+{
+	// Walk the IDs lowest first, which skips duplicates without sorting or copying the list. With the index table
+	// known, pages already empty need no deleting and can be deleted along with their neighbours to join two ranges into one
+	int32_t ID = nextDeleteWanted(IDs, count, 0);
+	while (ID >= 0)
 	{
-	case 0x0:
-		// No errors, just exit the switch
-		break;
-		
-	case 0x01:
+		// Extend the range over the IDs to delete as long as only empty pages lie between them
+		uint32_t end = ID + 1;
+		int32_t next = nextDeleteWanted(IDs, count, end);
+		while (next >= 0 && isRangeKnownFree(end, next))
 		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return false;
+			end = next + 1;
+			next = nextDeleteWanted(IDs, count, end);
 		}
-		break;
-		
-	case 0x0a:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_MERGING_FAILED;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
+
+		if (!deleteFingerprintRange(ID, end - ID))
 			return false;
-		}
-		break;
-		
-	default:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
+		ID = next;
+	}
+
+	response = AS108M_RESPONSE_CODES::AS108M_OK;
+	return true;
+}
+
+int32_t AS108M::nextDeleteWanted(const uint16_t* IDs, byte count, uint32_t from)
+{
+	int32_t lowest = -1;
+	for (byte i = 0; i < count; i++)
+	{
+		if (IDs[i] < from || (lowest >= 0 && IDs[i] >= lowest))
+			continue;
+
+		if (!isRangeKnownFree(IDs[i], IDs[i] + 1))
+			lowest = IDs[i];
+	}
+
+	return lowest;
+}
+
+bool AS108M::isRangeKnownFree(uint32_t startID, uint32_t endID)
+{
+	// Neighbouring pages have nothing between them
+	if (startID >= endID)
+		return true;
+
+	if (!_indexTableValid || endID > indexTableCapacity())
+		return false;
+
+	for (uint32_t ID = startID; ID < endID; ID++)
+	{
+		if (indexTable()[ID / 8] & (1 << (ID % 8)))
 			return false;
-		}
-		break;
 	}
-	
-	// Save contents into flash at address ID
-	byte saveContentsCommand[7] = { AS108M_FLAG_COMMAND, 0x00, 0x06, AS108M_STORE_CHAR, AS108M_BUFFER_ID_1, 0x00, ID };
-	sendPacket(saveContentsCommand, 7);
-	
-	// Empty the previously used reply struct
-	memset(&reply, 0, sizeof(reply));
-	reply.packetData[0] = 0xff;
-	
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	switch (reply.packetData[0])
+
+	return true;
+}
+
+bool AS108M::readIndexTable(bool forceRefresh)
+{
+	// Nothing to fetch if the cached copy is still good
+	if (_indexTableValid && !forceRefresh)
 	{
-	case 0x0:
-		// No errors, just exit the switch
-		break;
-		
-	case 0x01:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
+		response = AS108M_RESPONSE_CODES::AS108M_OK;
+		return true;
+	}
+
+	const AS108M_PACKET_DATA& reply = _rxPacket;
+
+	_indexTableValid = false;
+
+	// Index table page n covers pages n * 256 to n * 256 + 255
+	_enrolledCount = 0;
+	for (byte page = 0; page < _indexTablePages; page++)
+	{
+		byte readIndexCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_READ_INDEX_TABLE, page };
+		if (!sendCommand(readIndexCommand, 5))
 			return false;
-		}
-		break;		
-		
-	case 0x0b:
+
+		byte* table = indexTable() + page * AS108M_INDEX_TABLE_PAGE_SIZE;
+		for (byte i = 0; i < AS108M_INDEX_TABLE_PAGE_SIZE; i++)
 		{
-			response = AS108M_RESPONSE_CODES::AS108M_ADDRESS_EXCEEDING_DATABASE_LIMIT;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return false;
+			table[i] = reply.packetData[1 + i];
+			for (byte bits = table[i]; bits != 0; bits &= bits - 1)
+				_enrolledCount++;
 		}
-		break;
-		
-	case 0x18:
+	}
+
+	_indexTableValid = true;
+	return true;
+}
+
+void AS108M::setIndexTableBuffer(byte* buffer, byte pages)
+{
+	_indexTableBuffer = (pages > 0) ? buffer : NULL;
+	_indexTablePages = (_indexTableBuffer != NULL) ? pages : 1;
+	_indexTableValid = false;
+}
+
+void AS108M::setSlotUsed(uint16_t ID, bool used)
+{
+	// An unknown table stays unknown
+	if (!_indexTableValid || ID >= indexTableCapacity())
+		return;
+
+	byte mask = 1 << (ID % 8);
+	bool wasUsed = (indexTable()[ID / 8] & mask) != 0;
+
+	if (used && !wasUsed)
+	{
+		indexTable()[ID / 8] |= mask;
+		_enrolledCount++;
+	}
+	else if (!used && wasUsed)
+	{
+		indexTable()[ID / 8] &= ~mask;
+		_enrolledCount--;
+	}
+}
+
+bool AS108M::isSlotUsed(uint16_t ID)
+{
+	if (!readIndexTable() || ID >= indexTableCapacity())
+		return false;
+
+	return (indexTable()[ID / 8] & (1 << (ID % 8))) != 0;
+}
+
+int32_t AS108M::findFreeSlot(uint16_t startID)
+{
+	// Only pages inside the database are worth looking at
+	uint16_t databaseSize = readSystemParameters().databaseSize;
+	if (response != AS108M_RESPONSE_CODES::AS108M_OK || !readIndexTable())
+		return -1;
+
+	if (databaseSize > indexTableCapacity())
+		databaseSize = indexTableCapacity();
+
+	for (uint16_t ID = startID; ID < databaseSize; ID++)
+	{
+		// Skip full bytes at once
+		if (ID % 8 == 0 && indexTable()[ID / 8] == 0xff)
 		{
-			response = AS108M_RESPONSE_CODES::AS108M_FLASH_READ_WRITE_ERROR;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return false;
+			ID += 7;
+			continue;
 		}
-		break;
-		
-	default:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return false;
-		}
-		break;		
+		if (!(indexTable()[ID / 8] & (1 << (ID % 8))))
+			return ID;
 	}
-	
-	return true;
+
+	response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_DATABASE_FULL;
+	return -1;
 }
 
-bool AS108M::clearFingerprintDatabase()
+uint16_t AS108M::enrolledCount()
 {
-	// Set response as no response
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
-	
-	byte clearCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_EMPTY };
-	sendPacket(clearCommand, 4);
-	
-	// Set response as no response again
+	if (!readIndexTable())
+		return 0;
+
+	return _enrolledCount;
+}
+
+uint16_t AS108M::getValidTemplateCount()
+{
+	const AS108M_PACKET_DATA& reply = _rxPacket;
+
+	byte validTemplateCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_VALID_TEMPLATE_NUM };
+	if (!sendCommand(validTemplateCommand, 4))
+		return 0;
+
+	return reply.packetData[1] << 8 | reply.packetData[2];
+}
+
+AS108M_SYS_PARAMS AS108M::readSystemParameters(bool forceRefresh)
+{
+	// Nothing to fetch if the cached copy is still good
+	if (_sysParamsValid && !forceRefresh)
+	{
+		response = AS108M_RESPONSE_CODES::AS108M_OK;
+		return _sysParams;
+	}
+
+	const AS108M_PACKET_DATA& reply = _rxPacket;
+
+	_sysParamsValid = false;
+	_sysParams = AS108M_SYS_PARAMS();
+
+	byte readParaCommand[4] = {AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_READ_SYS_PARAMETER};
+	if (!sendCommand(readParaCommand, 4))
+		return _sysParams;
+
+	// Every parameter is sent MSB first, right after the confirm code
+	_sysParams.statusRegister = reply.packetData[1] << 8 | reply.packetData[2];
+	_sysParams.systemId = reply.packetData[3] << 8 | reply.packetData[4];
+	_sysParams.databaseSize = reply.packetData[5] << 8 | reply.packetData[6];
+	_sysParams.matchThreshold = reply.packetData[7] << 8 | reply.packetData[8];
+
+	// The address register lives in bytes 9 to 12 but the one in the reply header is kept instead.
+	// This allows easy recovery of the reader's address in case it's forgotten
+	_sysParams.address = _addressReplied;
+
+	// Packet size register holds 0 to 3 for 32, 64, 128 or 256 bytes
+	_sysParams.packetSize = 32 << (reply.packetData[14] & 0x03);
+
+	_sysParams.baudrateMultiplier = reply.packetData[15] << 8 | reply.packetData[16];
+
+	_sysParamsValid = true;
+	return _sysParams;
+}
+
+uint16_t AS108M::getDatabaseSize()
+{
+	return readSystemParameters().databaseSize;
+}
+
+uint32_t AS108M::getAddress()
+{
+	// Even if the reader is not using the address passed to begin() the reply header
+	// holds its actual address - which was already saved by readPacket function
+	readSystemParameters();
+	return _addressReplied;
+}
+
+uint32_t AS108M::getBaudrate()
+{
+	return readSystemParameters().baudrateMultiplier * 9600U;
+}
+
+uint8_t AS108M::getMatchThreshold()
+{
+	// The maximum value for the match threshold is 5 so a byte is enough
+	return static_cast<uint8_t>(readSystemParameters().matchThreshold);
+}
+
+bool AS108M::setMatchThreshold(uint8_t newMatchThreshold)
+{
+	// Cached system parameters are about to change
+	_sysParamsValid = false;
+
+	// Match threshold is in register #5
+	byte setCommand[6] = { AS108M_FLAG_COMMAND, 0x00, 0x05, AS108M_WRITE_REG, AS108M_MATCH_THRES_REG, newMatchThreshold };
+	return sendCommand(setCommand, 6);
+}
+
+uint16_t AS108M::getPacketSize()
+{
+	return readSystemParameters().packetSize;
+}
+
+bool AS108M::setPacketSize(AS108M_PACKET_SIZE newPacketSize)
+{
+	// Cached system parameters are about to change
+	_sysParamsValid = false;
+
+	// Packet size register is #6
+	byte setCommand[6] = { AS108M_FLAG_COMMAND, 0x00, 0x05, AS108M_WRITE_REG, AS108M_PACKET_SIZE_REG, static_cast<byte>(newPacketSize) };
+	return sendCommand(setCommand, 6);
+}
+
+bool AS108M::setBaudrate(AS108M_BAUDRATE newBaudrate)
+{
+	// Get multiplier from enum value
+	uint8_t multiplier = static_cast<uint8_t>(newBaudrate);
+
+	// Cached system parameters are about to change
+	_sysParamsValid = false;
+
+	// Baudrate register is #4
+	byte setCommand[6] = {AS108M_FLAG_COMMAND, 0x00, 0x05, AS108M_WRITE_REG, AS108M_BAUDRATE_CTRL_REG, multiplier};
+	return sendCommand(setCommand, 6);
+}
+
+uint32_t AS108M::detectBaudrate(void(*setHostBaudrate)(uint32_t baudrate))
+{
+	for (byte i = 0; i < sizeof(baudrateTable); i++)
+	{
+		uint32_t baudrate = pgm_read_byte(&baudrateTable[i]) * 9600UL;
+		changeHostBaudrate(setHostBaudrate, baudrate);
+
+		// A reader at another baudrate either stays quiet or replies garbage
+		if (isConnected(AS108M_BAUDRATE_PROBE_TIMEOUT))
+			return baudrate;
+	}
+
 	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	switch (reply.packetData[0])
+	return 0;
+}
+
+void AS108M::changeHostBaudrate(void(*setHostBaudrate)(uint32_t baudrate), uint32_t baudrate)
+{
+	setHostBaudrate(baudrate);
+
+	// Replies still due at the old baudrate can only come in as noise the receiver skips, there's nothing to wait for
+	_lateReplies = 0;
+}
+
+bool AS108M::negotiateBaudrate(void(*setHostBaudrate)(uint32_t baudrate), void(*powerCycle)(void), AS108M_BAUDRATE newBaudrate)
+{
+	uint32_t currentBaudrate = detectBaudrate(setHostBaudrate);
+	if (currentBaudrate == 0)
 	{
-	case 0x0:
-		// No errors, just exit the switch
-		break;
-		
-	case 0x01:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
+		if (pCallback != NULL)
+			pCallback();
+
+		return false;
+	}
+
+	// The reader only switches after a power cycle, without one it stays where it is
+	if (powerCycle == NULL)
+		return currentBaudrate == static_cast<byte>(newBaudrate) * 9600UL;
+
+	// Try newBaudrate first, then every slower one until the one the reader already works at
+	for (byte i = 0; i < sizeof(baudrateTable); i++)
+	{
+		byte multiplier = pgm_read_byte(&baudrateTable[i]);
+		uint32_t baudrate = multiplier * 9600UL;
+		if (multiplier > static_cast<byte>(newBaudrate))
+			continue;
+
+		// Make sure the reader keeps this baudrate after its next power cycle, whatever was tried before
+		if (baudrate == currentBaudrate)
+			return setBaudrate(static_cast<AS108M_BAUDRATE>(multiplier));
+
+		if (!setBaudrate(static_cast<AS108M_BAUDRATE>(multiplier)))
 			return false;
-		}
-		break;		
-		
-	case 0x11:
+
+		// The new baudrate is stored by the reader but only used after a power cycle
+		powerCycle();
+		sleep(AS108M_POWER_UP_DELAY);
+
+		// Check the link works at the new baudrate both ways, including a longer reply
+		changeHostBaudrate(setHostBaudrate, baudrate);
+		if (isConnected(AS108M_BAUDRATE_PROBE_TIMEOUT) && readSystemParameters(true).baudrateMultiplier == multiplier)
+			return true;
+
+		// Find the reader again, wherever it ended up
+		currentBaudrate = detectBaudrate(setHostBaudrate);
+		if (currentBaudrate == 0)
 		{
-			response = AS108M_RESPONSE_CODES::AS108M_FINGERPRINT_DATABASE_CLEAR_FAILED;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
+			if (pCallback != NULL)
 				pCallback();
-				
+
 			return false;
 		}
-		break;
-		
-	default:
+	}
+
+	// The reader only works faster than newBaudrate - keep it there and report the failure
+	setBaudrate(static_cast<AS108M_BAUDRATE>(currentBaudrate / 9600));
+	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
+	if (pCallback != NULL)
+		pCallback();
+
+	return false;
+}
+
+bool AS108M::setAddress(uint32_t newAddress)
+{
+	// Break the 32-bit address into 8 bit chunks
+	uint8_t b0 = newAddress >> 24;
+	uint8_t b1 = newAddress >> 16;
+	uint8_t b2 = newAddress >> 8;
+	uint8_t b3 = newAddress & 0x0000ff;
+
+	// Cached system parameters are about to change
+	_sysParamsValid = false;
+
+	// Build and send the command
+	byte setCommand[8] = {AS108M_FLAG_COMMAND, 0x00, 0x07, AS108M_SET_CHIP_ADDRESS, b0, b1, b2, b3};
+	return sendCommand(setCommand, 8);
+}
+
+bool AS108M::uploadTemplate(Print& sink, byte bufferId)
+{
+	// The reader acknowledges the command, then sends the template as data packets.
+	// Sending it again could mix up its data packets with a second reply, so it's never retried
+	byte upCharCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_UP_CHAR, bufferId };
+	if (!sendCommand(upCharCommand, 5, false))
+		return false;
+
+	return receiveData(sink);
+}
+
+bool AS108M::downloadTemplate(Stream& source, uint32_t size, byte bufferId)
+{
+	// Without even an end packet to send the reader would wait for one forever
+	if (size == 0)
+		return false;
+
+	// Data packets must be exactly as large as the reader expects them
+	uint16_t packetSize = readSystemParameters().packetSize;
+	if (response != AS108M_RESPONSE_CODES::AS108M_OK)
+		return false;
+
+	// The reader acknowledges the command, then waits for the template as data packets.
+	// Sending it again could be taken as template data, so it's never retried
+	byte downCharCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_DOWN_CHAR, bufferId };
+	if (!sendCommand(downCharCommand, 5, false))
+		return false;
+
+	return sendData(source, size, packetSize);
+}
+
+bool AS108M::storeTemplate(uint16_t ID, byte bufferId)
+{
+	byte storeCommand[7] = { AS108M_FLAG_COMMAND, 0x00, 0x06, AS108M_STORE_CHAR, bufferId, static_cast<byte>(ID >> 8), static_cast<byte>(ID & 0xff) };
+	if (!sendCommand(storeCommand, 7))
+		return false;
+
+	setSlotUsed(ID, true);
+	return true;
+}
+
+bool AS108M::loadTemplate(uint16_t ID, byte bufferId)
+{
+	byte loadCommand[7] = { AS108M_FLAG_COMMAND, 0x00, 0x06, AS108M_LOAD_CHAR, bufferId, static_cast<byte>(ID >> 8), static_cast<byte>(ID & 0xff) };
+	return sendCommand(loadCommand, 7);
+}
+
+bool AS108M::readNotepad(byte page, byte* data)
+{
+	byte readCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_READ_NOTEPAD, page };
+	if (!sendCommand(readCommand, 5))
+		return false;
+
+	// The page follows the confirm code
+	if (_rxPacket.packetLength < 1 + AS108M_NOTEPAD_PAGE_SIZE)
+	{
+		response = AS108M_RESPONSE_CODES::AS108M_INVALID_RESPONSE;
+		if (pCallback != NULL)
+			pCallback();
+
+		return false;
+	}
+
+	memcpy(data, &_rxPacket.packetData[1], AS108M_NOTEPAD_PAGE_SIZE);
+	return true;
+}
+
+bool AS108M::writeNotepad(byte page, const byte* data)
+{
+	byte writeCommand[5 + AS108M_NOTEPAD_PAGE_SIZE] = { AS108M_FLAG_COMMAND, 0x00, 4 + AS108M_NOTEPAD_PAGE_SIZE, AS108M_WRITE_NOTEPAD, page };
+	memcpy(&writeCommand[5], data, AS108M_NOTEPAD_PAGE_SIZE);
+	return sendCommand(writeCommand, sizeof(writeCommand));
+}
+
+bool AS108M::captureImage()
+{
+	byte getImageCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_GET_IMAGE };
+	return sendCommand(getImageCommand, 4);
+}
+
+bool AS108M::uploadImage(Print& sink)
+{
+	// The reader acknowledges the command, then sends the image as data packets. Like UP_CHAR, it's never retried
+	byte upImageCommand[4] = { AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_UP_IMAGE };
+	if (!sendCommand(upImageCommand, 4, false))
+		return false;
+
+	return receiveData(sink);
+}
+
+AS108M_TRANSFER_STATS AS108M::getTransferStats()
+{
+	return _transferStats;
+}
+
+bool AS108M::receiveData(Print& sink)
+{
+	uint32_t start = millis();
+	_transferStats = AS108M_TRANSFER_STATS();
+
+	// Every data packet is parsed straight into sink, the end packet holds the last chunk
+	_rxSink = &sink;
+	do
+	{
+		const AS108M_PACKET_DATA& packet = readPacket();
+		if (response == AS108M_RESPONSE_CODES::AS108M_OK && packet.flagType != FLAG_TYPE::DATA && packet.flagType != FLAG_TYPE::END)
+			response = AS108M_RESPONSE_CODES::AS108M_INVALID_RESPONSE;
+
+		if (response != AS108M_RESPONSE_CODES::AS108M_OK)
 		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+			_rxSink = NULL;
 
 			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
+			if (pCallback != NULL)
 				pCallback();
-				
+
 			return false;
 		}
-		break;		
+
+		_transferStats.bytes += packet.packetLength;
+		_transferStats.packets++;
+	} while (_rxPacket.flagType != FLAG_TYPE::END);
+	_rxSink = NULL;
+
+	finishTransfer(start);
+	return true;
+}
+
+bool AS108M::sendData(Stream& source, uint32_t size, uint16_t packetSize)
+{
+	uint32_t start = millis();
+	_transferStats = AS108M_TRANSFER_STATS();
+
+	uint32_t remaining = size;
+	while (remaining > 0)
+	{
+		// Every packet but the last one is full
+		uint16_t payloadSize = (remaining > packetSize) ? packetSize : remaining;
+		remaining -= payloadSize;
+
+		if (!sendDataPacket(source, payloadSize, remaining == 0))
+			return false;
 	}
-	
+
+	response = AS108M_RESPONSE_CODES::AS108M_OK;
+	finishTransfer(start);
 	return true;
 }
 
-bool AS108M::deleteFingerprintEntry(byte ID)
+bool AS108M::sendDataPacket(Stream& source, uint16_t payloadSize, bool last)
 {
-	// Set response as no response
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
-	
-	byte deleteCommand[8] = { AS108M_FLAG_COMMAND, 0x00, 0x07, AS108M_DELETE_CHAR, 0x00, ID, 0x00, 0x01 };
-	sendPacket(deleteCommand, 8);
-	
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Get the reply from the device
-	reply = readPacket();
-	
-	switch (reply.packetData[0])
+	beginDataPacket(payloadSize, last);
+	while (_txLeft > 0)
 	{
-	case 0x0:
-		// No errors, just exit the switch
-		break;
-		
-	case 0x01:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
+		if (!sendDataChunk(source))
 			return false;
-		}
-		break;		
-		
-	case 0x10:
+	}
+
+	return true;
+}
+
+void AS108M::beginDataPacket(uint16_t payloadSize, bool last)
+{
+	byte flag = last ? AS108M_FLAG_END : AS108M_FLAG_DATA;
+	uint16_t length = payloadSize + 2;
+	_txCheckSum = flag + (length >> 8) + (length & 0xff);
+	_txLeft = payloadSize;
+
+	const byte header[9] = { 0xef, 0x01, static_cast<byte>(_address >> 24), static_cast<byte>(_address >> 16), static_cast<byte>(_address >> 8), static_cast<byte>(_address & 0xff),
+		flag, static_cast<byte>(length >> 8), static_cast<byte>(length & 0xff) };
+	_comm->write(header, 9);
+	instrumentSent(9 + payloadSize + 2);
+
+	_transferStats.bytes += payloadSize;
+	_transferStats.packets++;
+
+	// An empty end packet has nothing but its checksum
+	if (_txLeft == 0)
+		endDataPacket();
+}
+
+bool AS108M::sendDataChunk(Stream& source)
+{
+	// Relay the payload in small chunks so no packet sized buffer is needed
+	byte chunk[16];
+	byte chunkSize = (_txLeft > sizeof(chunk)) ? sizeof(chunk) : _txLeft;
+	byte received = source.readBytes(chunk, chunkSize);
+	for (byte i = 0; i < received; i++)
+		_txCheckSum += chunk[i];
+
+	_comm->write(chunk, received);
+	_txLeft -= received;
+
+	if (received != chunkSize)
+	{
+		// The source ran dry. Cut short, the packet would be completed by whatever is sent next, so it's padded
+		// to the length its header announced and sent with a wrong checksum for the reader to reject it
+		memset(chunk, 0, sizeof(chunk));
+		while (_txLeft > 0)
 		{
-			response = AS108M_RESPONSE_CODES::AS108M_IMAGE_DELETING_FAILED;
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return false;
+			byte padSize = (_txLeft > sizeof(chunk)) ? sizeof(chunk) : _txLeft;
+			_comm->write(chunk, padSize);
+			_txLeft -= padSize;
 		}
-		break;
-		
-	default:
-		{
-			response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+		_txCheckSum = ~_txCheckSum;
+		endDataPacket();
+
+		response = AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT;
+		if (pCallback != NULL)
+			pCallback();
+
+		return false;
+	}
+
+	if (_txLeft == 0)
+		endDataPacket();
+
+	return true;
+}
+
+void AS108M::endDataPacket()
+{
+	const byte sum[2] = { static_cast<byte>(_txCheckSum >> 8), static_cast<byte>(_txCheckSum & 0x00ff) };
+	_comm->write(sum, 2);
+}
+
+void AS108M::finishTransfer(uint32_t start)
+{
+	_transferStats.elapsed = millis() - start;
+	_transferStats.bytesPerSecond = (_transferStats.elapsed > 0) ? (_transferStats.bytes * 1000UL) / _transferStats.elapsed : 0;
+}
+
+bool AS108M::startSearch(uint16_t startPage, uint16_t pageCount)
+{
+	if (_asyncStatus == AS108M_ASYNC_STATUS::BUSY)
+		return false;
+
+	// AS108M_SEARCH_AUTO needs the database size, which is only read from the reader once
+	pageCount = getSearchPageCount(startPage, pageCount);
+	if (pageCount == 0)
+		return false;
+
+	_asyncStartPage = startPage;
+	_asyncPageCount = pageCount;
+	return startOperation(AS108M_ASYNC_OPERATION::SEARCH, 0, 1);
+}
+
+bool AS108M::startMatch(uint16_t ID)
+{
+	return startOperation(AS108M_ASYNC_OPERATION::MATCH, ID, 1);
+}
 
-			// Callback the function passed if it's not NULL
-			if(pCallback != NULL)
-				pCallback();
-				
-			return false;
-		}
-		break;		
-	}
-	
-	return true;
+bool AS108M::startEnroll(uint16_t ID, byte numSamples)
+{
+	return startOperation(AS108M_ASYNC_OPERATION::ENROLL, ID, numSamples);
 }
 
-uint16_t AS108M::getDatabaseSize()
+bool AS108M::startOperation(AS108M_ASYNC_OPERATION operation, uint16_t ID, byte numSamples)
 {
-	byte readParaCommand[4] = {AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_READ_SYS_PARAMETER};
-	sendPacket(readParaCommand,4);
+	// Only one operation may be in flight at a time
+	if (_asyncStatus == AS108M_ASYNC_STATUS::BUSY)
+		return false;
+
+	_asyncOperation = operation;
+	_asyncId = ID;
+	_asyncSamples = numSamples;
+	_asyncSample = 1;
+	_asyncResult = AS108M_QUERY_DATA();
+	_asyncStatus = AS108M_ASYNC_STATUS::BUSY;
+	_asyncCaptureTime = millis();
+	_asyncAttempt = 1;
 
-	// Set response as no response again
+	// Every pipeline starts by reading the fingerprint image
+	scheduleAsyncStep(AS108M_ASYNC_STEP::GET_IMAGE);
+
+	// Set response as no response
 	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
-	
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
-	
-	// Get the reply from the device
-	reply = readPacket();
 
-	if(reply.packetData[0] == 0x01)
+	if (operation == AS108M_ASYNC_OPERATION::ENROLL)
 	{
-		response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-		// Callback the function passed if it's not NULL
+		response = AS108M_RESPONSE_CODES::AS108M_TOUCH_SENSOR;
 		if (pCallback != NULL)
 			pCallback();
-
-		return 0;
 	}
 
-	// Database size is located in bytes 5 and 6 in reply.packetData array
-	return ((reply.packetData[5] << 8) | reply.packetData[6]);
+	_fingerPollInterval = _fingerPollMinInterval;
+	return true;
 }
 
-uint32_t AS108M::getAddress()
+AS108M_ASYNC_STATUS AS108M::poll()
 {
-	byte readParaCommand[4] = {AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_READ_SYS_PARAMETER};
-	sendPacket(readParaCommand, 4);
+	// An identify stream starts over right after the previous result was handed out.
+	// The finger that produced it is most likely still on the sensor, so wait for it to go first
+	if (_asyncStreaming && _asyncStatus != AS108M_ASYNC_STATUS::BUSY)
+	{
+		_asyncResult = AS108M_QUERY_DATA();
+		_asyncStatus = AS108M_ASYNC_STATUS::BUSY;
+		scheduleAsyncStep(AS108M_ASYNC_STEP::WAIT_FINGER_REMOVAL);
+	}
 
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
+	if (_asyncStatus != AS108M_ASYNC_STATUS::BUSY)
+		return _asyncStatus;
+
+	if (!_asyncAwaitingReply)
+	{
+		// Nothing to do until the wait time between steps has elapsed
+		if (millis() - _asyncTimer < _asyncDelay)
+			return _asyncStatus;
+
+		// With a touch-out line there is no need to bother the reader until the finger state changes
+		if (pTouchCallback != NULL && _asyncStep == AS108M_ASYNC_STEP::WAIT_FINGER_REMOVAL)
+		{
+			if (pTouchCallback())
+			{
+				scheduleAsyncStep(AS108M_ASYNC_STEP::WAIT_FINGER_REMOVAL, _asyncStreaming ? 0 : nextFingerPollInterval());
+				return _asyncStatus;
+			}
+
+			scheduleAsyncStep((_asyncOperation == AS108M_ASYNC_OPERATION::ENROLL) ? AS108M_ASYNC_STEP::GET_CHAR : AS108M_ASYNC_STEP::GET_IMAGE);
+		}
 
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
+		if (pTouchCallback != NULL && _asyncStep == AS108M_ASYNC_STEP::GET_IMAGE && (_asyncOperation == AS108M_ASYNC_OPERATION::ENROLL || _asyncStreaming) && !pTouchCallback())
+		{
+			scheduleAsyncStep(AS108M_ASYNC_STEP::GET_IMAGE, _asyncStreaming ? 0 : nextFingerPollInterval());
+			return _asyncStatus;
+		}
 
-	// Get the reply from the device
-	reply = readPacket();
+		sendAsyncStep();
+	}
 
-	if (reply.packetData[0] == 0x01)
+	// Handle whatever already arrived, but never wait for more
+	const AS108M_PACKET_DATA* reply;
+	while ((reply = receivePacket()) != NULL)
 	{
-		response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
+		if (_asyncSyncing)
+		{
+			// Late replies are dropped until the sync command's reply shows they're all in
+			if (isSyncReply(*reply))
+			{
+				_commandAwaitingReply = false;
+				instrumentReply();
+				_lateReplies = 0;
+				sendAsyncStep();
+			}
+			else
+			{
+				if (_lateReplies > 0)
+					_lateReplies--;
+				if (_manager == NULL)
+					resetReceiver();
+			}
+			continue;
+		}
 
-		return 0;
+		_commandAwaitingReply = false;
+		_asyncAwaitingReply = false;
+		instrumentReply();
+		handleAsyncReply(*reply);
+
+		// Issue the next command right away instead of leaving the UART idle until the next poll(),
+		// unless other readers share the port and should get their turn first
+		if (_asyncStatus != AS108M_ASYNC_STATUS::BUSY || _asyncDelay != 0 || !_asyncChaining)
+			return _asyncStatus;
+
+		sendAsyncStep();
 	}
 
-	// Address is located in bytes 9, 10, 11 and 12 in  reply.packetData array
-	// return ((reply.packetData[9] << 24) | (reply.packetData[10] << 16) | (reply.packetData[11] << 8) | reply.packetData[12]);
+	if (_asyncSyncing)
+	{
+		// The reader did not answer the sync command in time, so whatever was late is lost by now
+		if (millis() - _asyncTimer > _asyncSyncTimeout)
+		{
+			_commandAwaitingReply = false;
+			instrumentTimeout();
+			_lateReplies = 0;
+			sendAsyncStep();
+		}
+		return _asyncStatus;
+	}
 
-	// Instead of retuning the reader's address from the reader's register get it from the reply header - which was already saved by readPacket function
-	// This allows easy recovery of the reader's address in case it's forgotten
-	return _addressReplied;
+	if (millis() - _asyncTimer > replyTimeout())
+	{
+		response = AS108M_RESPONSE_CODES::AS108M_RECEIVE_TIMEOUT;
+		instrumentTimeout();
+		noteLateReply();
+		if (!retryAsyncStep())
+			finishAsync(false);
+	}
+
+	return _asyncStatus;
 }
 
-uint32_t AS108M::getBaudrate()
+bool AS108M::startIdentifyStream(uint16_t startPage, uint16_t pageCount)
 {
-	byte readParaCommand[4] = {AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_READ_SYS_PARAMETER};
-	sendPacket(readParaCommand, 4);
+	if (!startSearch(startPage, pageCount))
+		return false;
 
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
+	_asyncStreaming = true;
+	return true;
+}
 
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
+void AS108M::stopIdentifyStream()
+{
+	_asyncStreaming = false;
+}
 
-	// Get the reply from the device
-	reply = readPacket();
+AS108M_ASYNC_STATUS AS108M::getAsyncStatus()
+{
+	return _asyncStatus;
+}
 
-	if (reply.packetData[0] == 0x01)
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
+AS108M_QUERY_DATA AS108M::getAsyncResult()
+{
+	return _asyncResult;
+}
 
-		return 0;
-	}
+uint32_t AS108M::getAsyncLatency()
+{
+	return _asyncLatency;
+}
 
-	// Baudrate is located in bytes 15 and 16 in the reply.packetData array
-	// but since the maximum value for the multiplier is 12 (115200/9600) we
-	// only need to parse the least significant byte of the baudrate information
-	uint8_t multiplier = reply.packetData[16];
-	return multiplier * 9600U;
+void AS108M::setAsyncCallback(void(*callBack)(void))
+{
+	pAsyncCallback = callBack;
 }
 
-uint8_t AS108M::getMatchThreshold()
+void AS108M::scheduleAsyncStep(AS108M_ASYNC_STEP step, uint32_t waitTime)
 {
-	byte readParaCommand[4] = {AS108M_FLAG_COMMAND, 0x00, 0x03, AS108M_READ_SYS_PARAMETER};
-	sendPacket(readParaCommand, 4);
+	_asyncStep = step;
+	_asyncAwaitingReply = false;
+	_asyncTimer = millis();
+	_asyncDelay = waitTime;
+}
 
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
+bool AS108M::retryAsyncStep()
+{
+	if (!isTransientFailure(response))
+	{
+		// A proper reply, the step is done with retrying
+		if (_asyncAttempt > 1)
+			_retryStats.recovered++;
+		_asyncAttempt = 1;
+		return false;
+	}
 
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
+	if (_asyncAttempt >= _retryPolicy.maxAttempts)
+	{
+		if (_asyncAttempt > 1)
+			_retryStats.exhausted++;
+		_asyncAttempt = 1;
+		return false;
+	}
 
-	// Get the reply from the device
-	reply = readPacket();
+	// Send the same step again, waiting twice as long before every further attempt
+	_retryStats.retries++;
+	scheduleAsyncStep(_asyncStep, retryBackoff(_asyncAttempt));
+	_asyncAttempt++;
+	return true;
+}
 
-	if (reply.packetData[0] == 0x01)
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
+uint16_t AS108M::nextFingerPollInterval()
+{
+	// Back off while the finger state does not change
+	uint16_t interval = _fingerPollInterval;
+	_fingerPollInterval = (interval * 2 < _fingerPollMaxInterval) ? interval * 2 : _fingerPollMaxInterval;
+	return interval;
+}
 
-		return 0;
+const AS108M_PACKET_DATA* AS108M::receivePacket()
+{
+	// Readers sharing their port get the packets addressed to them from the manager, which reads the port for all of them
+	if (_manager != NULL)
+		return _manager->popPacket(*this);
+
+	while (_comm->available() > 0)
+	{
+		if (parseByte(receiveByte()))
+			return &_rxPacket;
 	}
 
-	// Match threshold (or security rank) is located in bytes 7 and 8 in the reply.packetData array
-	// but since the maximum value for the match threshold is 5 we only need to parse the least
-	// significant byte of the match threshold information
-	return reply.packetData[8];
+	return NULL;
 }
 
-bool AS108M::setMatchThreshold(uint8_t newMatchThreshold)
+void AS108M::sendAsyncStep()
 {
-	// Match threshold is in register #5
-	byte setCommand[6] = { AS108M_FLAG_COMMAND, 0x00, 0x05, AS108M_WRITE_REG, AS108M_MATCH_THRES_REG, newMatchThreshold };
-	sendPacket(setCommand, 6);
+	// Anything received before the command goes out can't be its reply. Late replies still to come are waited
+	// for with a sync command, the step itself goes out once its reply is in
+	discardInput();
+	_asyncSyncing = expectLateReplies();
+	if (_asyncSyncing)
+		_asyncSyncTimeout = sendSyncCommand();
+	else
+		sendAsyncCommand();
+	_asyncAwaitingReply = true;
+	_asyncTimer = millis();
+}
 
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
+void AS108M::sendAsyncCommand()
+{
+	switch (_asyncStep)
+	{
+	case AS108M_ASYNC_STEP::GET_IMAGE:
+	case AS108M_ASYNC_STEP::WAIT_FINGER_REMOVAL:
+		sendSingleByteCommand(AS108M_GET_IMAGE);
+		break;
 
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
+	case AS108M_ASYNC_STEP::GET_CHAR:
+		{
+			// Enrolling stores each sample in its own BufferID, everything else uses BufferID 1
+			byte bufferId = (_asyncOperation == AS108M_ASYNC_OPERATION::ENROLL) ? _asyncSample : AS108M_BUFFER_ID_1;
+			byte genCharBufCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_GET_CHAR, bufferId };
+			sendPacket(genCharBufCommand, 5);
+		}
+		break;
 
-	// Get the reply from the device
-	reply = readPacket();
+	case AS108M_ASYNC_STEP::SEARCH:
+		{
+			byte searchCommand[9] = { AS108M_FLAG_COMMAND, 0x0, 0x08, AS108M_SEARCH, AS108M_BUFFER_ID_1,
+				static_cast<byte>(_asyncStartPage >> 8), static_cast<byte>(_asyncStartPage & 0xff), static_cast<byte>(_asyncPageCount >> 8), static_cast<byte>(_asyncPageCount & 0xff) };
+			sendPacket(searchCommand, 9);
+		}
+		break;
 
-	switch(reply.packetData[0])
-	{
-	case 0x0:
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_OK;
-		return true;
+	case AS108M_ASYNC_STEP::LOAD_CHAR:
+		{
+			byte loadCommand[7] = { AS108M_FLAG_COMMAND, 0x0, 0x06, AS108M_LOAD_CHAR, AS108M_BUFFER_ID_2, static_cast<byte>(_asyncId >> 8), static_cast<byte>(_asyncId & 0xff) };
+			sendPacket(loadCommand, 7);
+		}
+		break;
+
+	case AS108M_ASYNC_STEP::MATCH:
+		sendSingleByteCommand(AS108M_MATCH);
+		break;
+
+	case AS108M_ASYNC_STEP::REG_MODEL:
+		sendSingleByteCommand(AS108M_REG_MODEL);
+		break;
+
+	case AS108M_ASYNC_STEP::STORE_CHAR:
+		{
+			byte saveContentsCommand[7] = { AS108M_FLAG_COMMAND, 0x00, 0x06, AS108M_STORE_CHAR, AS108M_BUFFER_ID_1, static_cast<byte>(_asyncId >> 8), static_cast<byte>(_asyncId & 0xff) };
+			sendPacket(saveContentsCommand, 7);
+		}
+		break;
 	}
-	break;
+}
 
-	case 0x01:
-	{
+void AS108M::handleAsyncReply(const AS108M_PACKET_DATA& reply)
+{
+	byte confirmCode = reply.packetData[0];
+
+	// Noise and lost packets only cost sending the same step again
+	if (response == AS108M_RESPONSE_CODES::AS108M_OK && confirmCode == 0x01)
 		response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
 
-		return false;
-	}
-	break;
+	if (retryAsyncStep())
+		return;
 
-	case 0x1a:
+	// Bad checksum, address mismatch and so on
+	if (response != AS108M_RESPONSE_CODES::AS108M_OK)
 	{
-		response = AS108M_RESPONSE_CODES::AS108M_INVALID_REGISTER;
-		if (pCallback != NULL)
-			pCallback();
-
-		return false;
+		finishAsync(false);
+		return;
 	}
-	break;
 
-	default:
+	switch (_asyncStep)
 	{
-		response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+	case AS108M_ASYNC_STEP::GET_IMAGE:
+		// While enrolling or streaming keep waiting until the user touches the sensor
+		if (confirmCode == 0x02 && _asyncOperation == AS108M_ASYNC_OPERATION::ENROLL)
+		{
+			response = AS108M_RESPONSE_CODES::AS108M_NO_FINGER;
+			scheduleAsyncStep(AS108M_ASYNC_STEP::GET_IMAGE, nextFingerPollInterval());
+			return;
+		}
 
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
+		if (confirmCode == 0x02 && _asyncStreaming)
+		{
+			response = AS108M_RESPONSE_CODES::AS108M_NO_FINGER;
+			scheduleAsyncStep(AS108M_ASYNC_STEP::GET_IMAGE);
+			return;
+		}
 
-		return false;
-	}
-	break;
+		if (confirmCode != 0x00)
+			break;
 
-	}
+		// Latency is counted from the moment the image was asked for
+		_asyncCaptureTime = _asyncTimer;
 
-	return false;
-}
+		if (_asyncOperation == AS108M_ASYNC_OPERATION::ENROLL)
+		{
+			response = AS108M_RESPONSE_CODES::AS108M_REMOVE_FINGER;
+			if (pCallback != NULL)
+				pCallback();
+			_fingerPollInterval = _fingerPollMinInterval;
+			scheduleAsyncStep(AS108M_ASYNC_STEP::WAIT_FINGER_REMOVAL);
+		}
+		else
+			scheduleAsyncStep(AS108M_ASYNC_STEP::GET_CHAR);
+		return;
+
+	case AS108M_ASYNC_STEP::WAIT_FINGER_REMOVAL:
+		// Keep polling until the sensor reports no finger. Enrolling then generates the
+		// char buffer from the image it already has, identify streams read a new one
+		if (confirmCode != 0x02)
+			scheduleAsyncStep(AS108M_ASYNC_STEP::WAIT_FINGER_REMOVAL, _asyncStreaming ? 0 : nextFingerPollInterval());
+		else
+			scheduleAsyncStep((_asyncOperation == AS108M_ASYNC_OPERATION::ENROLL) ? AS108M_ASYNC_STEP::GET_CHAR : AS108M_ASYNC_STEP::GET_IMAGE);
+		return;
+
+	case AS108M_ASYNC_STEP::GET_CHAR:
+		if (confirmCode != 0x00)
+			break;
 
-bool AS108M::setBaudrate(AS108M_BAUDRATE newBaudrate)
-{
-	// Get multiplier from enum value
-	uint8_t multiplier = static_cast<uint8_t>(newBaudrate);
+		if (_asyncOperation == AS108M_ASYNC_OPERATION::SEARCH)
+			scheduleAsyncStep(AS108M_ASYNC_STEP::SEARCH);
+		else if (_asyncOperation == AS108M_ASYNC_OPERATION::MATCH)
+			scheduleAsyncStep(AS108M_ASYNC_STEP::LOAD_CHAR);
+		else if (_asyncSample < _asyncSamples)
+		{
+			// Ask for the next sample
+			_asyncSample++;
+			response = AS108M_RESPONSE_CODES::AS108M_TOUCH_SENSOR;
+			if (pCallback != NULL)
+				pCallback();
+			_fingerPollInterval = _fingerPollMinInterval;
+			scheduleAsyncStep(AS108M_ASYNC_STEP::GET_IMAGE);
+		}
+		else
+			scheduleAsyncStep(AS108M_ASYNC_STEP::REG_MODEL);
+		return;
 
-	// Baudrate register is #4
-	byte setCommand[6] = {AS108M_FLAG_COMMAND, 0x00, 0x05, AS108M_WRITE_REG, AS108M_BAUDRATE_CTRL_REG, multiplier};
-	sendPacket(setCommand, 6);
+	case AS108M_ASYNC_STEP::SEARCH:
+		if (confirmCode != 0x00)
+			break;
 
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
+		// Fingerprint match was found.
+		_asyncResult.found = true;
+		_asyncResult.pageId = reply.packetData[1] << 8 | reply.packetData[2];
+		_asyncResult.matchScore = reply.packetData[3] << 8 | reply.packetData[4];
+		finishAsync(true);
+		return;
 
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
+	case AS108M_ASYNC_STEP::LOAD_CHAR:
+		if (confirmCode != 0x00)
+			break;
 
-	// Get the reply from the device
-	reply = readPacket();
+		scheduleAsyncStep(AS108M_ASYNC_STEP::MATCH);
+		return;
 
-	switch (reply.packetData[0])
-	{
-	case 0x0:
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_OK;
-		return true;
-	}
-	break;
+	case AS108M_ASYNC_STEP::MATCH:
+		if (confirmCode != 0x00)
+			break;
 
-	case 0x01:
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
+		// Fingerprint match was found.
+		_asyncResult.found = true;
+		_asyncResult.pageId = _asyncId;
+		_asyncResult.matchScore = reply.packetData[1] << 8 | reply.packetData[2];
+		finishAsync(true);
+		return;
 
-		return false;
-	}
-	break;
+	case AS108M_ASYNC_STEP::REG_MODEL:
+		if (confirmCode != 0x00)
+			break;
 
-	case 0x1a:
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_INVALID_REGISTER;
-		if (pCallback != NULL)
-			pCallback();
+		scheduleAsyncStep(AS108M_ASYNC_STEP::STORE_CHAR);
+		return;
 
-		return false;
+	case AS108M_ASYNC_STEP::STORE_CHAR:
+		if (confirmCode != 0x00)
+			break;
+
+		setSlotUsed(_asyncId, true);
+		_asyncResult.found = true;
+		_asyncResult.pageId = _asyncId;
+		finishAsync(true);
+		return;
 	}
-	break;
 
-	default:
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+	// If we got this far the module replied with an error confirm code
+	response = getResponseCode(confirmCode);
+	finishAsync(false);
+}
 
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
+void AS108M::finishAsync(bool success)
+{
+	_asyncStatus = success ? AS108M_ASYNC_STATUS::COMPLETED : AS108M_ASYNC_STATUS::FAILED;
+	_asyncAwaitingReply = false;
+	_asyncLatency = millis() - _asyncCaptureTime;
 
-		return false;
-	}
-	break;
-	}
+	if (success)
+		response = AS108M_RESPONSE_CODES::AS108M_OK;
+	// Callback the function passed if it's not NULL
+	else if (pCallback != NULL)
+		pCallback();
 
-	return false;
+	// Let the user know the operation is over
+	if (pAsyncCallback != NULL)
+		pAsyncCallback();
 }
 
-bool AS108M::setAddress(uint32_t newAddress)
+byte AS108M::commandStatsIndex(byte command)
 {
-	// Break the 32-bit address into 8 bit chunks
-	uint8_t b0 = newAddress >> 24;
-	uint8_t b1 = newAddress >> 16;
-	uint8_t b2 = newAddress >> 8;
-	uint8_t b3 = newAddress & 0x0000ff;
+	byte i = 0;
+	while (i < AS108M_INSTRUMENTED_COMMANDS - 1 && pgm_read_byte(&instrumentedCommandTable[i]) != command)
+		i++;
 
-	// Build the command 
-	byte setCommand[8] = {AS108M_FLAG_COMMAND, 0x00, 0x07, AS108M_SET_CHIP_ADDRESS, b0, b1, b2, b3};
-	
-	// Send the packet
-	sendPacket(setCommand, 8);
+	return i;
+}
 
-	// Set response as no response again
-	response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
+#if AS108M_ENABLE_INSTRUMENTATION
+void AS108M::instrumentCommand(byte command)
+{
+	if (_instrumentation == NULL)
+		return;
+
+	_instrumentation->pendingCommand = commandStatsIndex(command);
+	_instrumentation->pendingCommandTime = millis();
+	_instrumentation->commandPending = true;
+}
 
-	// Create default reply struct
-	AS108M_PACKET_DATA reply;
+void AS108M::instrumentReply()
+{
+	// Data packets following a command's reply are not replies of their own
+	if (_instrumentation == NULL || !_instrumentation->commandPending)
+		return;
+	_instrumentation->commandPending = false;
+
+	AS108M_COMMAND_STATS& stats = _instrumentation->commands[_instrumentation->pendingCommand];
+	uint32_t latency = millis() - _instrumentation->pendingCommandTime;
+
+	if (stats.count == 0 || latency < stats.minLatency)
+		stats.minLatency = latency;
+	if (latency > stats.maxLatency)
+		stats.maxLatency = latency;
+	stats.count++;
+	stats.totalLatency += latency;
+	stats.meanLatency = stats.totalLatency / stats.count;
+
+	byte bucket = 0;
+	while (bucket < AS108M_LATENCY_BUCKETS - 1 && latency >= pgm_read_word(&latencyBucketTable[bucket]))
+		bucket++;
+	stats.histogram[bucket]++;
+}
 
-	// Get the reply from the device
-	reply = readPacket();
+void AS108M::instrumentTimeout()
+{
+	if (_instrumentation == NULL)
+		return;
 
-	switch (reply.packetData[0])
-	{
-	case 0x0:
+	_instrumentation->timeouts++;
+
+	if (_instrumentation->commandPending)
 	{
-		response = AS108M_RESPONSE_CODES::AS108M_OK;
-		return true;
+		_instrumentation->commands[_instrumentation->pendingCommand].timeouts++;
+		_instrumentation->commandPending = false;
 	}
-	break;
+}
+#endif
 
-	case 0x01:
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_DATA_PACKET_RECEIVE_ERROR;
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
+void AS108M::setInstrumentation(AS108M_INSTRUMENTATION* instrumentation)
+{
+	_instrumentation = instrumentation;
+}
 
-		return false;
-	}
-	break;
+const AS108M_COMMAND_STATS& AS108M::getCommandStats(byte command)
+{
+	static const AS108M_COMMAND_STATS none;
+	if (_instrumentation == NULL)
+		return none;
 
-	default:
-	{
-		response = AS108M_RESPONSE_CODES::AS108M_UNKNOWN_ERROR;
+	return _instrumentation->commands[commandStatsIndex(command)];
+}
 
-		// Callback the function passed if it's not NULL
-		if (pCallback != NULL)
-			pCallback();
+uint16_t AS108M::getLatencyBucketLimit(byte bucket)
+{
+	if (bucket >= AS108M_LATENCY_BUCKETS - 1)
+		return 0xffff;
 
-		return false;
-	}
-	break;
-	}
+	return pgm_read_word(&latencyBucketTable[bucket]);
+}
 
-	return false;
-}
\ No newline at end of file
+void AS108M::resetInstrumentation()
+{
+	if (_instrumentation != NULL)
+		*_instrumentation = AS108M_INSTRUMENTATION();
+}
@@ -21,12 +21,37 @@ https://www.sparkfun.com/products/17151
 #include "SparkFun_AS108M_Constants.h"
 #include <Arduino.h>
 
+class AS108M_MANAGER;
+
+// Struct that holds how commands are sent again after a timeout, a bad checksum or a packet receive error
+struct AS108M_RETRY_POLICY
+{
+	// Attempts per command, the first one included
+	byte maxAttempts = 3;
+	// Reply timeout in msec for each attempt, 0 waits as long as each command's own timeout
+	unsigned int timeout = 0;
+	// Wait in msec before the first retry, doubled before each further one up to AS108M_MAX_RETRY_BACKOFF
+	uint16_t backoff = 20;
+};
+
+// Struct that holds how often commands were sent again
+struct AS108M_RETRY_STATS
+{
+	// Commands sent again
+	uint32_t retries = 0;
+	// Commands that got a proper reply thanks to a retry
+	uint32_t recovered = 0;
+	// Commands that still failed after the last attempt
+	uint32_t exhausted = 0;
+};
+
 // Struct that holds packet data replied from the sensor
 struct AS108M_PACKET_DATA
 {
 	FLAG_TYPE flagType = FLAG_TYPE::INDETERMINATE;
-	byte packetLength = 0;
-	byte packetData[31] = { 0 };
+	uint16_t packetLength = 0;
+	// Largest reply is READ_INDEX_TABLE: confirm code plus 32 bytes of index table
+	byte packetData[33] = { 0 };
 };
 
 
@@ -35,13 +60,79 @@ struct AS108M_QUERY_DATA
 	// Flag that indicates if a fingerprint match was found
 	bool found = false;	
 	// Fingerprint database entry
-	byte pageId = 0;
+	uint16_t pageId = 0;
 	// Matching fingerprint score
 	unsigned int matchScore = 0;
 };
 
+// Struct that holds the system parameters read from the sensor
+struct AS108M_SYS_PARAMS
+{
+	// Status register
+	uint16_t statusRegister = 0;
+	// System identifier code
+	uint16_t systemId = 0;
+	// Fingerprint database size
+	uint16_t databaseSize = 0;
+	// Match threshold (security level)
+	uint16_t matchThreshold = 0;
+	// Reader's address, as replied in the packet header
+	uint32_t address = 0;
+	// Data packet size in bytes
+	uint16_t packetSize = 0;
+	// Baudrate multiplier (baudrate is N x 9600 bps)
+	uint16_t baudrateMultiplier = 0;
+};
+
+// Struct that holds the statistics of the last template or image transfer
+struct AS108M_TRANSFER_STATS
+{
+	// Payload bytes transferred
+	uint32_t bytes = 0;
+	// Data packets transferred, including the end packet
+	uint16_t packets = 0;
+	// Transfer time in msec
+	uint32_t elapsed = 0;
+	// Payload throughput in bytes per second
+	uint32_t bytesPerSecond = 0;
+};
+
+// Struct that holds the reply latencies of one instruction, in msec from sending the command to receiving its reply
+struct AS108M_COMMAND_STATS
+{
+	// Replies received and replies that never came
+	uint32_t count = 0;
+	uint32_t timeouts = 0;
+	uint32_t minLatency = 0;
+	uint32_t maxLatency = 0;
+	uint32_t meanLatency = 0;
+	uint32_t totalLatency = 0;
+	// Replies per latency range, see getLatencyBucketLimit()
+	uint16_t histogram[AS108M_LATENCY_BUCKETS] = {};
+};
+
+// Struct that holds everything the instrumentation collected, handed to a reader with setInstrumentation()
+struct AS108M_INSTRUMENTATION
+{
+	uint32_t bytesSent = 0;
+	uint32_t bytesReceived = 0;
+	// Packets that never came or failed their checksum, commands or data alike
+	uint32_t timeouts = 0;
+	uint32_t checksumErrors = 0;
+	// Time in msec spent blocked in delay()
+	uint32_t sleepTime = 0;
+	AS108M_COMMAND_STATS commands[AS108M_INSTRUMENTED_COMMANDS];
+	// Slot of the command waiting for its reply, when it was sent, and whether one is waiting at all
+	byte pendingCommand = 0;
+	uint32_t pendingCommandTime = 0;
+	bool commandPending = false;
+};
+
 class AS108M
 {
+	// The bus manager schedules the readers it holds around each other's replies
+	friend class AS108M_MANAGER;
+
 private:
 	// Pointer to the port used.
 	Stream* _comm = NULL;
@@ -56,12 +147,292 @@ private:
 	// Returns enumeration based on response value.
 	AS108M_RESPONSE_CODES getResponseCode(byte response);
 
-	// Reads a data packet from the device. Timeout in msec is optional and defaults to 5000
-	AS108M_PACKET_DATA readPacket(unsigned int timeout = 5000);
+	// Returns how many pages a search from startPage should cover. AS108M_SEARCH_AUTO
+	// is resolved to the rest of the database. Returns 0 if there is nothing to search.
+	uint16_t getSearchPageCount(uint16_t startPage, uint16_t pageCount);
+
+	// Sends a command packet, reads the reply and decodes its confirm code into response.
+	// Transient failures send the command again as the retry policy allows, unless retry is false.
+	// The reply is left in _rxPacket.
+	void exchangeCommand(const byte* command, byte commandSize, bool retry = true);
+
+	// Same as exchangeCommand() but calls back the user and returns false if anything but AS108M_OK came back.
+	bool sendCommand(const byte* command, byte commandSize, bool retry = true);
+
+	// Reply timeout of the last command sent, and the timeouts changed from their defaults.
+	unsigned int _commandTimeout = AS108M_DEFAULT_COMMAND_TIMEOUT;
+	struct
+	{
+		byte command;
+		unsigned int timeout;
+	} _timeoutOverrides[AS108M_MAX_TIMEOUT_OVERRIDES];
+	byte _timeoutOverrideCount = 0;
+
+	// Returns how long to wait for the reply to the last command sent.
+	unsigned int replyTimeout();
+
+	// Returns the timeout of command from the timeout table, the longest the reader may take to reply to it.
+	unsigned int defaultCommandTimeout(byte command);
+
+	// Last command sent, when it went out and whether its reply is still awaited.
+	byte _commandSent = 0;
+	uint32_t _commandSentAt = 0;
+	bool _commandAwaitingReply = false;
+
+	// Replies to commands given up on before the reader was done with them. They may still arrive and be taken
+	// for the reply to a later command, until the reader has had the longest time it may take for each of them.
+	byte _lateReplies = 0;
+	byte _lateCommand = 0;
+	uint32_t _lateDeadline = 0;
+
+	// Counts the reply to the last command sent as late if the reader may still send it.
+	void noteLateReply();
+
+	// Reads and drops everything received so far and restarts the receiver. Packets among it are late replies coming in.
+	void discardInput();
+
+	// Returns true if late replies may still arrive, otherwise forgets about them.
+	bool expectLateReplies();
+
+	// Sends a command whose reply can't be mistaken for a late one. The reader works on one command at a time,
+	// so every late reply comes in before it. Returns how long to wait for its reply in msec.
+	unsigned int sendSyncCommand();
+	byte _syncCommand = 0;
+
+	// Returns true if reply is the reply to the last sync command.
+	bool isSyncReply(const AS108M_PACKET_DATA& reply);
+
+	// Switches the host to baudrate and forgets the late replies expected at the previous one.
+	void changeHostBaudrate(void(*setHostBaudrate)(uint32_t baudrate), uint32_t baudrate);
+
+	// Makes sure nothing but the reply to the next command sent is taken for it: drops what was received so far
+	// and, if late replies may still arrive, waits for them with a sync command. poll() does the same without blocking.
+	void discardLateReplies();
+
+	// Reads the reply to a command sent with sendPacket() and decodes its confirm code into response, without retrying.
+	// Calls back the user and returns false if anything but AS108M_OK came back.
+	bool readReply();
+
+	// Returns true for failures worth sending the same command again for.
+	bool isTransientFailure(AS108M_RESPONSE_CODES code);
+
+	// Retry policy and how it has fared so far.
+	AS108M_RETRY_POLICY _retryPolicy;
+	AS108M_RETRY_STATS _retryStats;
+
+	// Returns the wait in msec before the retry that follows the given attempt.
+	uint16_t retryBackoff(byte attempt);
+
+	// Reads a data packet from the device. Timeout in msec is optional and defaults to the timeout of the last command sent
+	// The returned reference stays valid until the next packet is received.
+	// Packets are parsed in place into _rxPacket, so commands read their replies from there without copying them.
+	const AS108M_PACKET_DATA& readPacket(unsigned int timeout = 0);
+
+	// Packet receiver state. Packets are parsed byte by byte as they arrive so
+	// readPacket() returns as soon as the last checksum byte is received.
+	PACKET_FIELD _rxField = PACKET_FIELD::HEADER;
+	uint16_t _rxIndex = 0;
+	uint32_t _rxAddress = 0;
+	uint16_t _rxLength = 0;
+	uint16_t _rxCheckSum = 0;
+	uint16_t _rxReceivedCheckSum = 0;
+	AS108M_PACKET_DATA _rxPacket;
+
+	// While set, the payload of data and end packets is written here as it arrives instead of into _rxPacket.
+	Print* _rxSink = NULL;
+	bool _rxToSink = false;
+
+	// Restarts the packet receiver, discarding any partially received packet.
+	void resetReceiver();
+
+	// Feeds one received byte to the packet receiver. Noise is skipped until a plausible header is found.
+	// Returns true when a packet is complete and response holds the outcome.
+	bool parseByte(byte data);
+
+	// Drops a header that turned out to be noise when data can't be its flag or length, and hunts for the
+	// real header in the bytes received since then. Returns true if a packet was completed meanwhile.
+	bool resync(byte data);
+
+	// Feeds the bytes of a packet that failed its checksum back to the receiver, starting at the next header
+	// found in them. Returns false if there's none, as the packet was then just corrupted.
+	bool replayAfterBadChecksum();
+
+	// Copies the bytes received after the header into received and returns how many there are.
+	byte saveReceived(byte* received);
+
+	// Returns where the next header starts in received, or receivedSize if there's none.
+	byte findHeader(const byte* received, byte receivedSize);
+
+	// Restarts the receiver and feeds it received from start on. Returns true if a packet was completed.
+	bool replay(const byte* received, byte receivedSize, byte start);
+	bool _rxReplaying = false;
+
+	// Bytes skipped by the packet receiver because they were not part of any packet.
+	uint32_t _rxDiscarded = 0;
 	
+	// Reads one byte from the port.
+	byte receiveByte();
+
+	// Waits ms msec.
+	void sleep(unsigned long ms);
+
+	// Instrumentation hooks, they compile to nothing unless AS108M_ENABLE_INSTRUMENTATION is set
+	// and do nothing until setInstrumentation() gave them somewhere to collect into.
+#if AS108M_ENABLE_INSTRUMENTATION
+	void instrumentCommand(byte command);
+	void instrumentReply();
+	void instrumentTimeout();
+	void instrumentSent(uint16_t bytes) { if (_instrumentation != NULL) _instrumentation->bytesSent += bytes; }
+	void instrumentReceived(uint16_t bytes = 1) { if (_instrumentation != NULL) _instrumentation->bytesReceived += bytes; }
+	void instrumentChecksumError() { if (_instrumentation != NULL) _instrumentation->checksumErrors++; }
+	void instrumentSleep(unsigned long ms) { if (_instrumentation != NULL) _instrumentation->sleepTime += ms; }
+#else
+	void instrumentCommand(byte) {}
+	void instrumentReply() {}
+	void instrumentTimeout() {}
+	void instrumentSent(uint16_t) {}
+	void instrumentReceived(uint16_t = 1) {}
+	void instrumentChecksumError() {}
+	void instrumentSleep(unsigned long) {}
+#endif
+
+	// Statistics slot of an instruction.
+	byte commandStatsIndex(byte command);
+
+	// Where the instrumentation collects into, NULL for nowhere. Only a pointer, so the class looks the same
+	// and costs no more RAM whatever AS108M_ENABLE_INSTRUMENTATION is set to.
+	AS108M_INSTRUMENTATION* _instrumentation = NULL;
+
 	// Function pointer to optional callback function.
 	void(*pCallback)(void) = NULL;
 
+	// Statistics of the last data transfer.
+	AS108M_TRANSFER_STATS _transferStats;
+
+	// Receives data packets into sink until the end packet arrives, checking every packet's checksum.
+	bool receiveData(Print& sink);
+
+	// Sends size bytes read from source as packetSize long data packets followed by an end packet.
+	bool sendData(Stream& source, uint32_t size, uint16_t packetSize);
+
+	// Sends payloadSize bytes read from source as one data packet, or as the end packet if last is true.
+	bool sendDataPacket(Stream& source, uint16_t payloadSize, bool last);
+
+	// The same, a step at a time so packets to readers on other ports can be sent in between: beginDataPacket()
+	// sends the header, each sendDataChunk() up to 16 payload bytes, and the checksum follows the last chunk.
+	// _txLeft holds how many payload bytes are still to be sent.
+	void beginDataPacket(uint16_t payloadSize, bool last);
+	bool sendDataChunk(Stream& source);
+	void endDataPacket();
+	uint16_t _txLeft = 0;
+	uint16_t _txCheckSum = 0;
+
+	// Fills in the elapsed time and throughput of a transfer started at start.
+	void finishTransfer(uint32_t start);
+
+	// System parameters cached by readSystemParameters(). Any command that
+	// changes one of them clears _sysParamsValid so the next read fetches them again.
+	AS108M_SYS_PARAMS _sysParams;
+	bool _sysParamsValid = false;
+
+	// Returns the lowest of the count IDs that is from or above and not known to be empty, -1 if there is none.
+	int32_t nextDeleteWanted(const uint16_t* IDs, byte count, uint32_t from);
+
+	// Returns true if the cached index table knows every page from startID up to (not including) endID to be empty.
+	bool isRangeKnownFree(uint32_t startID, uint32_t endID);
+
+	// Template occupancy cached by readIndexTable(), one bit per page (bit 0 of byte 0 is page 0).
+	// Enrolling, deleting and clearing keep it in sync with the reader. Pages beyond it are never known to be free.
+	// It's the index table page held here unless setIndexTableBuffer() handed over a larger buffer.
+	byte _indexTablePage[AS108M_INDEX_TABLE_PAGE_SIZE] = { 0 };
+	byte* _indexTableBuffer = NULL;
+	byte _indexTablePages = 1;
+	bool _indexTableValid = false;
+	uint16_t _enrolledCount = 0;
+
+	// Returns the cached index table and how many pages it covers.
+	byte* indexTable() { return (_indexTableBuffer != NULL) ? _indexTableBuffer : _indexTablePage; }
+	uint16_t indexTableCapacity() { return _indexTablePages * AS108M_INDEX_TABLE_PAGE_SIZE * 8; }
+
+	// Marks page ID as used or free in the cached index table.
+	void setSlotUsed(uint16_t ID, bool used);
+
+	// Non-blocking operation state, advanced by poll().
+	AS108M_ASYNC_STATUS _asyncStatus = AS108M_ASYNC_STATUS::IDLE;
+	AS108M_ASYNC_OPERATION _asyncOperation = AS108M_ASYNC_OPERATION::NONE;
+	AS108M_ASYNC_STEP _asyncStep = AS108M_ASYNC_STEP::GET_IMAGE;
+	AS108M_QUERY_DATA _asyncResult;
+	uint16_t _asyncId = 0;
+	uint16_t _asyncStartPage = 0;
+	uint16_t _asyncPageCount = 0;
+	byte _asyncSamples = 0;
+	byte _asyncSample = 0;
+	bool _asyncAwaitingReply = false;
+	bool _asyncSyncing = false;
+	unsigned int _asyncSyncTimeout = 0;
+	bool _asyncStreaming = false;
+	bool _asyncChaining = true;
+
+	// Manager that reads this reader's packets when it shares its port with other readers.
+	AS108M_MANAGER* _manager = NULL;
+
+	// Set by the manager while this reader parses the packets of every reader on its port, which the manager
+	// sorts out by address. Packets parsed meanwhile are neither checked against nor taken for this reader's address.
+	bool _rxRouting = false;
+	uint32_t _asyncTimer = 0;
+	uint32_t _asyncDelay = 0;
+	uint32_t _asyncCaptureTime = 0;
+	uint32_t _asyncLatency = 0;
+	byte _asyncAttempt = 1;
+
+	// Finger polling intervals in msec while waiting for a touch or a removal.
+	// Polling starts at the minimum after each prompt and doubles up to the maximum.
+	uint16_t _fingerPollMinInterval = 20;
+	uint16_t _fingerPollMaxInterval = 200;
+	uint16_t _fingerPollInterval = 20;
+
+	// Function pointer to optional function that reads the reader's touch-out line.
+	bool(*pTouchCallback)(void) = NULL;
+
+	// Captures numSamples images, one per buffer, and merges them into a model in BufferID 1.
+	bool captureModel(byte numSamples);
+
+	// Blocks until a finger is on the sensor (present is true) or gone from it, polling with back-off.
+	// Returns false if the reader reports an error while waiting for a touch.
+	bool waitForFinger(bool present);
+
+	// Returns the current non-blocking finger polling interval and backs it off for the next poll.
+	uint16_t nextFingerPollInterval();
+
+	// Function pointer to optional completion callback for non-blocking operations.
+	void(*pAsyncCallback)(void) = NULL;
+
+	// Starts a non-blocking operation. Returns false if another one is still running.
+	bool startOperation(AS108M_ASYNC_OPERATION operation, uint16_t ID, byte numSamples);
+
+	// Sends the command for the current non-blocking step, or a sync command first if late replies may still arrive,
+	// and starts waiting for its reply.
+	void sendAsyncStep();
+
+	// Sends the command for the current non-blocking step.
+	void sendAsyncCommand();
+
+	// Returns the next packet received without waiting for it, or NULL if none is complete yet.
+	const AS108M_PACKET_DATA* receivePacket();
+
+	// Handles the reply to the current non-blocking step and selects the next one.
+	void handleAsyncReply(const AS108M_PACKET_DATA& reply);
+
+	// Schedules the current non-blocking step again if response is a transient failure and the retry policy allows it.
+	// Returns false if the step is not retried.
+	bool retryAsyncStep();
+
+	// Schedules the next non-blocking step after waitTime msec.
+	void scheduleAsyncStep(AS108M_ASYNC_STEP step, uint32_t waitTime = 0);
+
+	// Ends the current non-blocking operation and calls back the user.
+	void finishAsync(bool success);
+
 	
 public:
 	
@@ -78,24 +449,70 @@ public:
 	// Callback is an optional pointer to a function that returns void and accepts void.
 	bool begin(Stream& commPort, uint32_t address = 0xffffffff, void(*callBack)(void) = NULL);
 	
-	// Returns true if AS108M replies accordingly using the settings from begin.
-	bool isConnected();
+	// Returns how many received bytes were skipped as noise while looking for packets.
+	uint32_t getDiscardedBytes();
+
+	// Returns true if AS108M replies accordingly using the settings from begin. Timeout in msec is optional and defaults to the CANCEL timeout
+	bool isConnected(unsigned int timeout = 0);
 	
 	// Zeroes the device's fingerprint database.
 	bool clearFingerprintDatabase();
 	
 	// Returns true if a fingerprint was correctly enrolled in position ID. 
-	bool enrollFingerprint(byte ID, byte numSamples = 5);
+	bool enrollFingerprint(uint16_t ID, byte numSamples = 5);
 	
+	// Enrolls a fingerprint like enrollFingerprint() but writes the merged template to sink instead of storing it,
+	// e.g. to store it on other readers. The template is also left in BufferID 1.
+	bool captureTemplate(Print& sink, byte numSamples = 5);
+
 	// Returns true if fingerprint matches the ID passed as paramenter, false otherwise.
-	AS108M_QUERY_DATA getFingerprintMatch(byte ID);
+	AS108M_QUERY_DATA getFingerprintMatch(uint16_t ID);
+
+	// Reads the finger once and matches it against each of the candidateCount pages listed in candidates.
+	// The best resultCount candidates are written to results, highest matchScore first, with found set on those
+	// the reader considers a match. Unmatched candidates are ranked by their score too, so the margin between the
+	// first and second candidates can be told. Candidates whose page holds no template are skipped.
+	// Returns how many results were written, 0 with the callback called if the finger could not be read or a command failed.
+	byte identifyFingerprint(const uint16_t* candidates, byte candidateCount, AS108M_QUERY_DATA* results, byte resultCount);
 	
-	// Search for the fingerprint in the device's enrolled fingerprint memory. 
-	// This function will wait three attempts spaced timeBetweenRetries msec if no finger is in sensor before returning.
-	AS108M_QUERY_DATA searchFingerprint();
+	// Search for the fingerprint in the device's enrolled fingerprint memory, from startPage up to pageCount pages.
+	// Passing AS108M_SEARCH_AUTO as pageCount searches up to the end of the database reported by the reader.
+	AS108M_QUERY_DATA searchFingerprint(uint16_t startPage = 0, uint16_t pageCount = 0x28);
 	
 	// Deletes a specific fingerprint entry from the database.
-	bool deleteFingerprintEntry(byte ID);
+	bool deleteFingerprintEntry(uint16_t ID);
+
+	// Deletes count entries from startID on with a single DELETE_CHAR command.
+	bool deleteFingerprintRange(uint16_t startID, uint16_t count);
+
+	// Deletes the count entries listed in IDs, in any order, with as few DELETE_CHAR commands as possible:
+	// neighbouring IDs are deleted as one range, and so are IDs only apart by pages the cached index table
+	// knows to be empty. IDs the cached index table knows to be empty are not deleted at all.
+	bool deleteFingerprintEntries(const uint16_t* IDs, byte count);
+
+	// Reads all system parameters with a single READ_SYS_PARAMETER command and caches them.
+	// Later calls return the cached copy unless forceRefresh is true.
+	AS108M_SYS_PARAMS readSystemParameters(bool forceRefresh = false);
+
+	// Reads which pages hold a fingerprint with one READ_INDEX_TABLE command per index table page and caches them.
+	// Later calls use the cached copy unless forceRefresh is true.
+	bool readIndexTable(bool forceRefresh = false);
+
+	// Caches pages index table pages in buffer, pages * AS108M_INDEX_TABLE_PAGE_SIZE bytes that must stay valid, instead
+	// of the single one the reader holds, for readers holding more than 256 templates. NULL goes back to that one.
+	void setIndexTableBuffer(byte* buffer, byte pages);
+
+	// Returns true if page ID holds an enrolled fingerprint. Pages beyond the cached index table read as unused.
+	bool isSlotUsed(uint16_t ID);
+
+	// Returns the first free page from startID on, or -1 if the database is full or no page the cached index table covers is free.
+	int32_t findFreeSlot(uint16_t startID = 0);
+
+	// Returns how many fingerprints are enrolled, according to the cached index table.
+	uint16_t enrolledCount();
+
+	// Asks the reader how many valid templates it holds.
+	uint16_t getValidTemplateCount();
 
 	// Get database size
 	uint16_t getDatabaseSize();
@@ -112,10 +529,134 @@ public:
 	// Set match threshold value
 	bool setMatchThreshold(uint8_t newMatchThreshold);
 
+	// Get data packet size in bytes
+	uint16_t getPacketSize();
+
+	// Set data packet size. Larger packets cut the per packet overhead of template and image transfers
+	bool setPacketSize(AS108M_PACKET_SIZE newPacketSize);
+
 	// Set baudrate
 	bool setBaudrate(AS108M_BAUDRATE newBaudrate);
 
+	// Finds the reader's baudrate by probing every AS108M_BAUDRATE, fastest first. setHostBaudrate must switch the
+	// port passed to begin() to the baudrate it is given. Returns the baudrate found, leaving the port at it, or 0.
+	uint32_t detectBaudrate(void(*setHostBaudrate)(uint32_t baudrate));
+
+	// Finds the reader's baudrate and moves the reader and the host port to newBaudrate. The reader only applies
+	// a new baudrate after a power cycle, done by the powerCycle function. If the link does not work at newBaudrate
+	// the next slower baudrate is tried. Returns true once both sides talk at newBaudrate or at the fastest slower
+	// baudrate that works, false if the reader could not be found or moved. Without powerCycle the reader is only
+	// found, and true is returned if it already works at newBaudrate.
+	bool negotiateBaudrate(void(*setHostBaudrate)(uint32_t baudrate), void(*powerCycle)(void) = NULL, AS108M_BAUDRATE newBaudrate = AS108M_BAUDRATE::AS108M_115200);
+
 	// Changes the reader's address
 	bool setAddress(uint32_t newAddress);
+
+	// Uploads the template held in bufferId to sink. Every data packet is checked and written to sink
+	// as it arrives so the template is never held in RAM. If this fails, discard what was written.
+	bool uploadTemplate(Print& sink, byte bufferId = AS108M_BUFFER_ID_1);
+
+	// Downloads a template of size bytes read from source into bufferId, without holding it in RAM.
+	// Returns false without sending anything if size is 0. If source runs dry, the packet being sent is spoiled
+	// so the reader drops it.
+	bool downloadTemplate(Stream& source, uint32_t size, byte bufferId = AS108M_BUFFER_ID_1);
+
+	// Stores the template held in bufferId into the reader's database at page ID.
+	bool storeTemplate(uint16_t ID, byte bufferId = AS108M_BUFFER_ID_1);
+
+	// Loads the template stored at page ID into bufferId.
+	bool loadTemplate(uint16_t ID, byte bufferId = AS108M_BUFFER_ID_1);
+
+	// Reads AS108M_NOTEPAD_PAGE_SIZE bytes from notepad page into data.
+	bool readNotepad(byte page, byte* data);
+
+	// Writes AS108M_NOTEPAD_PAGE_SIZE bytes from data into notepad page. The notepad keeps them across power cycles.
+	bool writeNotepad(byte page, const byte* data);
+
+	// Takes a fingerprint image into the reader's image buffer. Returns false if there's no finger on the sensor.
+	bool captureImage();
+
+	// Uploads the image held in the reader's image buffer to sink, e.g. an SD card file or a network client.
+	// Every data packet is checked and written to sink as it arrives so RAM use does not depend on the image size.
+	// If this fails, discard what was written.
+	bool uploadImage(Print& sink);
+
+	// Returns the size, duration and throughput of the last template or image transfer.
+	AS108M_TRANSFER_STATS getTransferStats();
+
+	// Returns how long in msec the reply to an instruction (AS108M_SEARCH, AS108M_STORE_CHAR...) is waited for.
+	unsigned int getCommandTimeout(byte command);
+
+	// Changes how long in msec the reply to an instruction is waited for, 0 restores its default.
+	// Returns false if AS108M_MAX_TIMEOUT_OVERRIDES instructions already have their timeout changed.
+	bool setCommandTimeout(byte command, unsigned int timeout);
+
+	// Sets how many times, after what wait and with what reply timeout a command is sent again after a timeout,
+	// a bad checksum or a packet receive error. Only the failed command is sent again, so a search that fails
+	// on SEARCH does not need the finger again. Template and image transfers are never retried.
+	void setRetryPolicy(AS108M_RETRY_POLICY policy);
+
+	// Returns the retry policy in use.
+	AS108M_RETRY_POLICY getRetryPolicy();
+
+	// Returns how often commands were sent again and how that went.
+	AS108M_RETRY_STATS getRetryStats();
+
+	// Clears the retry statistics.
+	void resetRetryStats();
+
+	// Sets how often enrolling polls the sensor while waiting for the finger to touch or leave it.
+	// Polling starts every minInterval msec after each prompt and backs off up to maxInterval msec.
+	void setFingerPolling(uint16_t minInterval, uint16_t maxInterval);
+
+	// Sets an optional function that returns true while a finger touches the sensor, e.g. by reading
+	// the reader's touch-out pin. The sensor is then only polled once the finger state has changed.
+	void setTouchCallback(bool(*touchCallBack)(void));
+
+	// Non-blocking versions of searchFingerprint, getFingerprintMatch and enrollFingerprint.
+	// These return immediately (false if another operation is still running); call poll()
+	// from loop() until it stops returning BUSY, then read the outcome with getAsyncResult().
+	// Do not call the blocking functions while an operation is running.
+	bool startSearch(uint16_t startPage = 0, uint16_t pageCount = 0x28);
+	bool startMatch(uint16_t ID);
+	bool startEnroll(uint16_t ID, byte numSamples = 5);
+
+	// Advances the running non-blocking operation without waiting and returns its status.
+	AS108M_ASYNC_STATUS poll();
+
+	// Starts searching continuously: every time a finger is identified (or fails to be) poll() returns
+	// COMPLETED (or FAILED) once, the completion callback is called and a new search begins as soon as
+	// the finger leaves the sensor. Commands are chained back to back without waiting for the next poll().
+	bool startIdentifyStream(uint16_t startPage = 0, uint16_t pageCount = 0x28);
+
+	// Lets the running identify stream finish its current search and stop. Keep calling poll() until it stops returning BUSY.
+	void stopIdentifyStream();
+
+	// Returns the status of the last non-blocking operation.
+	AS108M_ASYNC_STATUS getAsyncStatus();
+
+	// Returns the result of the last non-blocking operation. For enrolling, found is true
+	// and pageId holds the ID if the fingerprint was stored.
+	AS108M_QUERY_DATA getAsyncResult();
+
+	// Returns the time in msec from asking for the fingerprint image to the end of the last non-blocking operation.
+	uint32_t getAsyncLatency();
+
+	// Collects the traffic, error and sleep counters along with the reply latencies of every instrumented instruction
+	// into instrumentation from now on, NULL to stop. Nothing is collected unless AS108M_ENABLE_INSTRUMENTATION is set.
+	void setInstrumentation(AS108M_INSTRUMENTATION* instrumentation);
+
+	// Returns the reply latencies of an instruction (AS108M_SEARCH, AS108M_STORE_CHAR...) out of what setInstrumentation()
+	// was given, all 0 if it was given nothing. Instructions without statistics of their own share the last entry.
+	const AS108M_COMMAND_STATS& getCommandStats(byte command);
+
+	// Returns the upper latency limit in msec of a histogram bucket. The last bucket has no limit and returns 0xffff.
+	uint16_t getLatencyBucketLimit(byte bucket);
+
+	// Clears everything the instrumentation collected.
+	void resetInstrumentation();
+
+	// Sets an optional function that is called when a non-blocking operation ends.
+	void setAsyncCallback(void(*callBack)(void));
 };
 #endif
\ No newline at end of file
@@ -21,6 +21,13 @@ https://www.sparkfun.com/products/17151
 
 #include <Arduino.h>
 
+// Set to 1 here or with -DAS108M_ENABLE_INSTRUMENTATION=1 in the build flags to collect the per-command latency
+// and traffic statistics into the struct handed to setInstrumentation(). Left at 0 the code collecting them is
+// compiled out. The statistics live in that struct rather than in the reader, so the class is the same either way
+#ifndef AS108M_ENABLE_INSTRUMENTATION
+#define AS108M_ENABLE_INSTRUMENTATION 0
+#endif
+
 // Flag types
 const byte AS108M_FLAG_COMMAND =		0x01;
 const byte AS108M_FLAG_DATA	=			0x02;
@@ -63,6 +70,50 @@ const byte AS108M_BAUDRATE_CTRL_REG = 	0x04;
 const byte AS108M_MATCH_THRES_REG = 	0x05;
 const byte AS108M_PACKET_SIZE_REG = 	0x06;
 
+// Reply timeout in msec for instructions without a default of their own, and how many instructions
+// can have their reply timeout changed with setCommandTimeout()
+const unsigned int AS108M_DEFAULT_COMMAND_TIMEOUT =	1000;
+const byte AS108M_MAX_TIMEOUT_OVERRIDES =			4;
+
+// Number of instructions with latency statistics of their own, the last one gathers every other instruction,
+// and number of latency histogram buckets
+const byte AS108M_INSTRUMENTED_COMMANDS =	15;
+const byte AS108M_LATENCY_BUCKETS =			8;
+
+// Bytes of one index table page, one bit per template page
+const byte AS108M_INDEX_TABLE_PAGE_SIZE =	32;
+
+// Reply payload sizes, confirm code included, of READ_SYS_PARAMETER and READ_INDEX_TABLE
+const byte AS108M_SYS_PARAMETER_REPLY_SIZE =	17;
+const byte AS108M_INDEX_TABLE_REPLY_SIZE =		1 + AS108M_INDEX_TABLE_PAGE_SIZE;
+
+// The reader's notepad holds this many pages of this many bytes each
+const byte AS108M_NOTEPAD_PAGES =		16;
+const byte AS108M_NOTEPAD_PAGE_SIZE =	32;
+
+// Largest template an AS108M_REPOSITORY slot holds by default, and the first notepad page it uses on each reader
+const uint16_t AS108M_REPOSITORY_SLOT_SIZE =	512;
+const byte AS108M_REPOSITORY_NOTEPAD_PAGE =		12;
+
+// Largest data packet the reader can be configured to send or receive
+const uint16_t AS108M_MAX_DATA_PACKET_SIZE =	256;
+
+// How long to wait in msec for a reply while probing baudrates, and for the reader to start after a power cycle
+const unsigned int AS108M_BAUDRATE_PROBE_TIMEOUT =	100;
+const unsigned int AS108M_POWER_UP_DELAY =			150;
+
+// Longest wait in msec between two attempts of a command, however often the retry backoff was doubled
+const uint16_t AS108M_MAX_RETRY_BACKOFF =	1000;
+
+// Maximum number of readers an AS108M_MANAGER can hold
+const byte AS108M_MAX_READERS =			4;
+
+// Number of packets an AS108M_MANAGER holds for each reader on a shared port until the reader takes them
+const byte AS108M_RX_QUEUE_SIZE =		2;
+
+// Search page count that makes searchFingerprint() search the whole database
+const uint16_t AS108M_SEARCH_AUTO =		0;
+
 // Enumerations
 enum class PACKET_FIELD : byte
 {
@@ -93,6 +144,42 @@ enum class AS108M_BAUDRATE : byte
 	AS108M_115200 = 12,
 };
 
+enum class AS108M_PACKET_SIZE : byte
+{
+	AS108M_32_BYTES = 0,
+	AS108M_64_BYTES = 1,
+	AS108M_128_BYTES = 2,
+	AS108M_256_BYTES = 3,
+};
+
+enum class AS108M_ASYNC_STATUS : byte
+{
+	IDLE,						// No operation was started yet
+	BUSY,						// Operation in progress, keep calling poll()
+	COMPLETED,					// Operation finished successfully
+	FAILED,						// Operation failed, response holds the reason
+};
+
+enum class AS108M_ASYNC_OPERATION : byte
+{
+	NONE,
+	SEARCH,
+	MATCH,
+	ENROLL,
+};
+
+enum class AS108M_ASYNC_STEP : byte
+{
+	GET_IMAGE,
+	WAIT_FINGER_REMOVAL,
+	GET_CHAR,
+	SEARCH,
+	LOAD_CHAR,
+	MATCH,
+	REG_MODEL,
+	STORE_CHAR,
+};
+
 enum class AS108M_RESPONSE_CODES : byte
 {
 	AS108M_OK,											// 0, No error
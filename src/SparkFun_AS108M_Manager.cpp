@@ -0,0 +1,562 @@
+/*
+  This is a library written for the AS108M Capacitive Fingerprint Scanner
+  SparkFun sells these at its website:
+https://www.sparkfun.com/products/17151
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  Written by Ricardo Ramos  @ SparkFun Electronics, April 14th, 2021
+  This file implements the manager that runs several AS108M readers side by side.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_AS108M_Manager.h"
+
+// Reads a template held in RAM as a Stream, so each reader being sent the template has its own position in it
+class AS108M_MEMORY_SOURCE : public Stream
+{
+private:
+	const byte* _data = NULL;
+	uint16_t _size = 0;
+	uint16_t _position = 0;
+
+public:
+	void begin(const byte* data, uint16_t size)
+	{
+		_data = data;
+		_size = size;
+		_position = 0;
+	}
+
+	int available()
+	{
+		return _size - _position;
+	}
+
+	int peek()
+	{
+		return (_position < _size) ? _data[_position] : -1;
+	}
+
+	int read()
+	{
+		return (_position < _size) ? _data[_position++] : -1;
+	}
+
+	size_t write(uint8_t)
+	{
+		return 0;
+	}
+};
+
+// Writes a template into RAM as a Print
+class AS108M_MEMORY_SINK : public Print
+{
+private:
+	byte* _data;
+	uint16_t _capacity;
+
+public:
+	uint16_t size = 0;
+	bool overflow = false;
+
+	AS108M_MEMORY_SINK(byte* data, uint16_t capacity) : _data(data), _capacity(capacity) {}
+
+	size_t write(uint8_t data)
+	{
+		if (size == _capacity)
+		{
+			overflow = true;
+			return 0;
+		}
+
+		_data[size++] = data;
+		return 1;
+	}
+};
+
+bool AS108M_MANAGER::addReader(AS108M& reader)
+{
+	if (_readerCount >= AS108M_MAX_READERS)
+		return false;
+
+	// Readers sharing a port hand it over after every reply instead of chaining their commands,
+	// and their packets are read by the manager and routed to them by address
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (_readers[i]->_comm == reader._comm)
+		{
+			_readers[i]->_asyncChaining = false;
+			_readers[i]->_manager = this;
+			_readers[i]->resetReceiver();
+			reader._asyncChaining = false;
+			reader._manager = this;
+		}
+	}
+
+	_readers[_readerCount] = &reader;
+	_lastStatus[_readerCount] = reader.getAsyncStatus();
+	_rxQueueHead[_readerCount] = 0;
+	_rxQueueCount[_readerCount] = 0;
+	_readerCount++;
+	return true;
+}
+
+byte AS108M_MANAGER::getReaderCount()
+{
+	return _readerCount;
+}
+
+AS108M& AS108M_MANAGER::getReader(byte index)
+{
+	return *_readers[index];
+}
+
+bool AS108M_MANAGER::startIdentifyStreams(uint16_t startPage, uint16_t pageCount)
+{
+	bool success = true;
+	for (byte i = 0; i < _readerCount; i++)
+		success &= _readers[i]->startIdentifyStream(startPage, pageCount);
+
+	return success;
+}
+
+void AS108M_MANAGER::stopIdentifyStreams()
+{
+	for (byte i = 0; i < _readerCount; i++)
+		_readers[i]->stopIdentifyStream();
+}
+
+bool AS108M_MANAGER::isBusFree(byte index)
+{
+	// Replies from two readers on the same port would collide, so only one command may be in flight per port
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (i != index && _readers[i]->_comm == _readers[index]->_comm && _readers[i]->_asyncAwaitingReply)
+			return false;
+	}
+
+	return true;
+}
+
+bool AS108M_MANAGER::hasPortOwner(byte index)
+{
+	for (byte i = 0; i < index; i++)
+	{
+		if (_readers[i]->_comm == _readers[index]->_comm)
+			return true;
+	}
+
+	return false;
+}
+
+void AS108M_MANAGER::waitForPort(byte index)
+{
+	bool waiting = true;
+	while (waiting)
+	{
+		routePackets();
+
+		// A queued reply is safe, the reader finds it on its next poll()
+		waiting = false;
+		for (byte i = 0; i < _readerCount; i++)
+		{
+			AS108M* peer = _readers[i];
+			if (i == index || peer->_comm != _readers[index]->_comm || !peer->_asyncAwaitingReply || _rxQueueCount[i] > 0)
+				continue;
+
+			unsigned int timeout = peer->_asyncSyncing ? peer->_asyncSyncTimeout : peer->replyTimeout();
+			waiting |= (millis() - peer->_asyncTimer <= timeout);
+		}
+	}
+}
+
+void AS108M_MANAGER::routePackets()
+{
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		// Every shared port is parsed once, by the first reader on it
+		AS108M* parser = _readers[i];
+		if (parser->_manager == NULL || hasPortOwner(i))
+			continue;
+
+		// Parsing sets response, which belongs to the reader's own operations
+		AS108M_RESPONSE_CODES savedResponse = parser->response;
+		parser->_rxRouting = true;
+
+		// A blocking call of the parser leaves its reply in the receiver, which then ignores everything
+		if (parser->_rxField == PACKET_FIELD::INVALID)
+			parser->resetReceiver();
+
+		while (parser->_comm->available() > 0)
+		{
+			// Bytes are counted for the reader a packet turns out to be for, not for the one parsing it
+			_routedBytes[i]++;
+			if (!parser->parseByte(static_cast<byte>(parser->_comm->read())))
+				continue;
+
+			// Whatever came before the packet was noise on the port, which the parsing reader reads
+			uint16_t packetBytes = 9 + parser->_rxPacket.packetLength + 2;
+			if (_routedBytes[i] > packetBytes)
+				parser->instrumentReceived(_routedBytes[i] - packetBytes);
+			_routedBytes[i] = 0;
+
+			// Find the reader the packet is addressed to
+			byte target = _readerCount;
+			for (byte j = i; j < _readerCount; j++)
+			{
+				if (_readers[j]->_comm == parser->_comm && _readers[j]->_address == parser->_rxAddress)
+				{
+					target = j;
+					break;
+				}
+			}
+
+			if (target == _readerCount)
+			{
+				parser->instrumentReceived(packetBytes);
+				_unroutedPackets++;
+			}
+			else
+			{
+				_readers[target]->instrumentReceived(packetBytes);
+
+				// A full queue drops its oldest packet, the reader has most likely given up waiting for it anyway
+				if (_rxQueueCount[target] == AS108M_RX_QUEUE_SIZE)
+				{
+					_rxQueueHead[target] = (_rxQueueHead[target] + 1) % AS108M_RX_QUEUE_SIZE;
+					_rxQueueCount[target]--;
+					_stats[target].lostPackets++;
+				}
+
+				byte slot = (_rxQueueHead[target] + _rxQueueCount[target]) % AS108M_RX_QUEUE_SIZE;
+				_rxQueue[target][slot] = parser->_rxPacket;
+				_rxQueueResponse[target][slot] = parser->response;
+				_rxQueueCount[target]++;
+			}
+
+			// Start hunting for the next packet
+			parser->resetReceiver();
+		}
+
+		parser->_rxRouting = false;
+		parser->response = savedResponse;
+	}
+}
+
+const AS108M_PACKET_DATA* AS108M_MANAGER::popPacket(AS108M& reader)
+{
+	byte index = indexOf(reader);
+	if (index == _readerCount || _rxQueueCount[index] == 0)
+		return NULL;
+
+	byte slot = _rxQueueHead[index];
+	_rxQueueHead[index] = (slot + 1) % AS108M_RX_QUEUE_SIZE;
+	_rxQueueCount[index]--;
+
+	reader.response = _rxQueueResponse[index][slot];
+	return &_rxQueue[index][slot];
+}
+
+void AS108M_MANAGER::flushPackets(AS108M& reader)
+{
+	byte index = indexOf(reader);
+	if (index < _readerCount)
+		_rxQueueCount[index] = 0;
+}
+
+byte AS108M_MANAGER::indexOf(AS108M& reader)
+{
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (_readers[i] == &reader)
+			return i;
+	}
+
+	return _readerCount;
+}
+
+bool AS108M_MANAGER::poll()
+{
+	bool busy = false;
+
+	// Sort out everything received on shared ports before any reader looks for its reply
+	routePackets();
+
+	for (byte n = 0; n < _readerCount; n++)
+	{
+		byte i = (_nextReader + n) % _readerCount;
+		AS108M* reader = _readers[i];
+
+		// A reader waiting for its turn on a shared port just keeps waiting
+		if (!isBusFree(i))
+		{
+			busy = true;
+			continue;
+		}
+
+		AS108M_ASYNC_STATUS status = reader->poll();
+
+		// Operations that just ended update the statistics and are handed to the user
+		if (status != AS108M_ASYNC_STATUS::BUSY && _lastStatus[i] == AS108M_ASYNC_STATUS::BUSY)
+		{
+			uint32_t latency = reader->getAsyncLatency();
+
+			if (status == AS108M_ASYNC_STATUS::COMPLETED)
+				_stats[i].completed++;
+			else
+				_stats[i].failed++;
+
+			_stats[i].lastLatency = latency;
+			if (latency > _stats[i].maxLatency)
+				_stats[i].maxLatency = latency;
+			_totalLatency[i] += latency;
+
+			// Callback the function passed if it's not NULL
+			if (pCallback != NULL)
+				pCallback(i, status);
+		}
+
+		_lastStatus[i] = status;
+		if (status == AS108M_ASYNC_STATUS::BUSY)
+			busy = true;
+	}
+
+	// Next time the following reader goes first
+	if (_readerCount > 0)
+		_nextReader = (_nextReader + 1) % _readerCount;
+
+	return busy;
+}
+
+AS108M_READER_STATS AS108M_MANAGER::getStats(byte index)
+{
+	AS108M_READER_STATS stats = _stats[index];
+	uint32_t operations = stats.completed + stats.failed;
+	stats.averageLatency = (operations > 0) ? _totalLatency[index] / operations : 0;
+	return stats;
+}
+
+uint32_t AS108M_MANAGER::getUnroutedPackets()
+{
+	return _unroutedPackets;
+}
+
+void AS108M_MANAGER::resetStats()
+{
+	for (byte i = 0; i < AS108M_MAX_READERS; i++)
+	{
+		_stats[i] = AS108M_READER_STATS();
+		_totalLatency[i] = 0;
+	}
+
+	_unroutedPackets = 0;
+}
+
+void AS108M_MANAGER::setCallback(void(*callBack)(byte index, AS108M_ASYNC_STATUS status))
+{
+	pCallback = callBack;
+}
+
+byte AS108M_MANAGER::deployTemplate(const byte* data, uint16_t size, uint16_t ID)
+{
+	return deploy(data, size, ID, AS108M_MAX_READERS);
+}
+
+byte AS108M_MANAGER::enrollTemplate(byte index, uint16_t ID, byte* buffer, uint16_t bufferSize, byte numSamples)
+{
+	for (byte i = 0; i < _readerCount; i++)
+		_deployResults[i] = AS108M_DEPLOY_RESULT();
+
+	if (index >= _readerCount || _readers[index]->getAsyncStatus() == AS108M_ASYNC_STATUS::BUSY)
+		return 0;
+
+	// Enroll once, keep the merged template
+	AS108M& reader = *_readers[index];
+	waitForPort(index);
+	AS108M_MEMORY_SINK sink(buffer, bufferSize);
+	uint32_t start = millis();
+	if (!reader.captureTemplate(sink, numSamples) || sink.overflow)
+	{
+		_deployResults[index].response = sink.overflow ? AS108M_RESPONSE_CODES::AS108M_FEATURE_UPLOAD_FAILED : reader.response;
+		return 0;
+	}
+
+	// The enrolling reader still holds the template in BufferID 1
+	AS108M_DEPLOY_RESULT& result = _deployResults[index];
+	result.success = reader.storeTemplate(ID, AS108M_BUFFER_ID_1);
+	result.response = reader.response;
+	result.elapsed = millis() - start;
+	if (!result.success)
+		return 0;
+
+	// Every other reader gets it without the finger
+	return 1 + deploy(buffer, sink.size, ID, index);
+}
+
+AS108M_DEPLOY_RESULT AS108M_MANAGER::getDeployResult(byte index)
+{
+	return _deployResults[index];
+}
+
+byte AS108M_MANAGER::deploy(const byte* data, uint16_t size, uint16_t ID, byte skip)
+{
+	bool pending[AS108M_MAX_READERS] = { false };
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (i == skip)
+			continue;
+
+		_deployResults[i] = AS108M_DEPLOY_RESULT();
+
+		// Readers busy with an operation are left alone, and there is nothing to deploy without a template
+		pending[i] = (size > 0 && _readers[i]->getAsyncStatus() != AS108M_ASYNC_STATUS::BUSY);
+	}
+
+	// Each round takes one pending reader per port, so replies on a shared port can't get mixed up
+	while (true)
+	{
+		bool round[AS108M_MAX_READERS] = { false };
+		bool any = false;
+		for (byte i = 0; i < _readerCount; i++)
+		{
+			if (!pending[i])
+				continue;
+
+			bool portTaken = false;
+			for (byte j = 0; j < i; j++)
+				portTaken |= round[j] && _readers[j]->_comm == _readers[i]->_comm;
+
+			if (!portTaken)
+			{
+				round[i] = true;
+				pending[i] = false;
+				any = true;
+			}
+		}
+
+		if (!any)
+			break;
+
+		deployRound(data, size, ID, round);
+	}
+
+	byte stored = 0;
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (i != skip && _deployResults[i].success)
+			stored++;
+	}
+
+	return stored;
+}
+
+void AS108M_MANAGER::deployRound(const byte* data, uint16_t size, uint16_t ID, const bool* round)
+{
+	bool active[AS108M_MAX_READERS] = { false };
+	uint16_t packetSize[AS108M_MAX_READERS] = { 0 };
+	uint32_t start = millis();
+
+	// Data packets must be exactly as large as each reader expects them
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (!round[i])
+			continue;
+
+		waitForPort(i);
+		packetSize[i] = _readers[i]->readSystemParameters().packetSize;
+		active[i] = (_readers[i]->response == AS108M_RESPONSE_CODES::AS108M_OK && packetSize[i] > 0);
+		_deployResults[i].response = _readers[i]->response;
+	}
+
+	// Every step goes out to all readers before any reply is waited for, so the readers work side by side
+	const byte downCharCommand[5] = { AS108M_FLAG_COMMAND, 0x00, 0x04, AS108M_DOWN_CHAR, AS108M_BUFFER_ID_1 };
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (!active[i])
+			continue;
+
+		_readers[i]->discardLateReplies();
+		_readers[i]->sendPacket(downCharCommand, 5);
+	}
+
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (active[i])
+			active[i] = _readers[i]->readReply();
+	}
+
+	// A small chunk per reader in turn keeps every port transmitting at once, as no write blocks for long on a full transmit buffer
+	AS108M_MEMORY_SOURCE sources[AS108M_MAX_READERS];
+	uint16_t remaining[AS108M_MAX_READERS] = { 0 };
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (!active[i])
+			continue;
+
+		sources[i].begin(data, size);
+		remaining[i] = size;
+		_readers[i]->_transferStats = AS108M_TRANSFER_STATS();
+	}
+
+	bool sending = true;
+	while (sending)
+	{
+		sending = false;
+		for (byte i = 0; i < _readerCount; i++)
+		{
+			AS108M& reader = *_readers[i];
+			if (!active[i] || (remaining[i] == 0 && reader._txLeft == 0))
+				continue;
+
+			// Next packet, every one but the last is full
+			if (reader._txLeft == 0)
+			{
+				uint16_t payloadSize = (remaining[i] > packetSize[i]) ? packetSize[i] : remaining[i];
+				remaining[i] -= payloadSize;
+				reader.beginDataPacket(payloadSize, remaining[i] == 0);
+			}
+
+			if (reader._txLeft > 0)
+				active[i] = reader.sendDataChunk(sources[i]);
+
+			sending |= active[i] && (remaining[i] > 0 || reader._txLeft > 0);
+		}
+	}
+
+	// Flash writes overlap as well
+	const byte storeCommand[7] = { AS108M_FLAG_COMMAND, 0x00, 0x06, AS108M_STORE_CHAR, AS108M_BUFFER_ID_1, static_cast<byte>(ID >> 8), static_cast<byte>(ID & 0xff) };
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (active[i])
+			_readers[i]->sendPacket(storeCommand, 7);
+	}
+
+	for (byte i = 0; i < _readerCount; i++)
+	{
+		if (!round[i])
+			continue;
+
+		AS108M_DEPLOY_RESULT& result = _deployResults[i];
+		if (active[i])
+		{
+			result.success = _readers[i]->readReply();
+			if (result.success)
+				_readers[i]->setSlotUsed(ID, true);
+		}
+
+		result.response = _readers[i]->response;
+		result.elapsed = millis() - start;
+		if (result.success)
+		{
+			result.bytesPerSecond = (result.elapsed > 0) ? (size * 1000UL) / result.elapsed : 0;
+			_readers[i]->finishTransfer(start);
+		}
+	}
+}
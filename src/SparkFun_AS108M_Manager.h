@@ -0,0 +1,167 @@
+/*
+  This is a library written for the AS108M Capacitive Fingerprint Scanner
+  SparkFun sells these at its website:
+https://www.sparkfun.com/products/17151
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  Written by Ricardo Ramos  @ SparkFun Electronics, April 14th, 2021
+  This file declares the manager that runs several AS108M readers side by side.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SparkFun_AS108M_Manager__
+#define __SparkFun_AS108M_Manager__
+#include "SparkFun_AS108M_Constants.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+#include <Arduino.h>
+
+// Struct that holds the statistics of one reader
+struct AS108M_READER_STATS
+{
+	// Non-blocking operations that completed or failed
+	uint32_t completed = 0;
+	uint32_t failed = 0;
+	// Time in msec from asking for the fingerprint image to the end of the operation
+	uint32_t lastLatency = 0;
+	uint32_t maxLatency = 0;
+	uint32_t averageLatency = 0;
+	// Packets addressed to the reader on a shared port that were dropped because its queue was full
+	uint32_t lostPackets = 0;
+};
+
+// Struct that holds how storing a template on one reader went
+struct AS108M_DEPLOY_RESULT
+{
+	// True if the template was stored, otherwise response tells why not
+	bool success = false;
+	AS108M_RESPONSE_CODES response = AS108M_RESPONSE_CODES::AS108M_NO_RESPONSE;
+	// Time in msec from sending DOWN_CHAR to the STORE_CHAR reply
+	uint32_t elapsed = 0;
+	// Template bytes per second over that time
+	uint32_t bytesPerSecond = 0;
+};
+
+class AS108M_MANAGER
+{
+	// Readers on a shared port take their packets from the manager
+	friend class AS108M;
+
+private:
+	// Readers held, in the order they were added.
+	AS108M* _readers[AS108M_MAX_READERS] = { NULL };
+	byte _readerCount = 0;
+
+	// Reader that gets the first turn on the next poll, so every reader gets the bus in turn.
+	byte _nextReader = 0;
+
+	// Status returned by each reader's last poll, to spot operations that just ended.
+	AS108M_ASYNC_STATUS _lastStatus[AS108M_MAX_READERS];
+
+	// Per reader statistics and the latency sum their average is taken from.
+	AS108M_READER_STATS _stats[AS108M_MAX_READERS];
+	uint32_t _totalLatency[AS108M_MAX_READERS] = { 0 };
+
+	// Function pointer to optional callback function called when an operation on a reader ends.
+	void(*pCallback)(byte index, AS108M_ASYNC_STATUS status) = NULL;
+
+	// Returns true if no other reader sharing reader index's port is waiting for a reply.
+	bool isBusFree(byte index);
+
+	// Returns true if reader index shares its port with a reader added before it.
+	bool hasPortOwner(byte index);
+
+	// Waits until the replies other readers sharing reader index's port are waiting for are queued for them,
+	// or overdue, so that blocking calls on reader index neither swallow nor collide with them.
+	void waitForPort(byte index);
+
+	// Packets read from shared ports, waiting for the reader they are addressed to. Each reader has its own ring.
+	AS108M_PACKET_DATA _rxQueue[AS108M_MAX_READERS][AS108M_RX_QUEUE_SIZE];
+	AS108M_RESPONSE_CODES _rxQueueResponse[AS108M_MAX_READERS][AS108M_RX_QUEUE_SIZE];
+	byte _rxQueueHead[AS108M_MAX_READERS] = { 0 };
+	byte _rxQueueCount[AS108M_MAX_READERS] = { 0 };
+
+	// Packets read from shared ports that no reader is listening to.
+	uint32_t _unroutedPackets = 0;
+
+	// Bytes read from each shared port since its last packet, by the first reader on it.
+	uint16_t _routedBytes[AS108M_MAX_READERS] = { 0 };
+
+	// Outcome of the last template deployment on each reader.
+	AS108M_DEPLOY_RESULT _deployResults[AS108M_MAX_READERS];
+
+	// Stores a template on every idle reader but skip. Returns how many readers stored it.
+	byte deploy(const byte* data, uint16_t size, uint16_t ID, byte skip);
+
+	// Stores a template on the readers flagged in round, which are all on different ports, side by side.
+	void deployRound(const byte* data, uint16_t size, uint16_t ID, const bool* round);
+
+	// Reads every shared port once, through the first reader on it, and queues each packet for the reader
+	// whose address it carries. Packets for a reader are kept even while other readers are being served.
+	void routePackets();
+
+	// Returns the oldest packet queued for reader and sets its response, or NULL if there's none.
+	// The packet stays valid until the next routePackets().
+	const AS108M_PACKET_DATA* popPacket(AS108M& reader);
+
+	// Drops every packet queued for reader.
+	void flushPackets(AS108M& reader);
+
+	// Returns the index of reader.
+	byte indexOf(AS108M& reader);
+
+public:
+	// Adds a reader already started with begin(). Readers on their own port run fully in parallel,
+	// readers sharing a port (told apart by their addresses) take turns sending commands.
+	// Returns false if AS108M_MAX_READERS readers are held already.
+	bool addReader(AS108M& reader);
+
+	// Returns how many readers are held.
+	byte getReaderCount();
+
+	// Returns reader index, e.g. to start an operation on it or to read its result.
+	AS108M& getReader(byte index);
+
+	// Starts an identify stream on every reader.
+	bool startIdentifyStreams(uint16_t startPage = 0, uint16_t pageCount = 0x28);
+
+	// Lets every identify stream finish its current search and stop.
+	void stopIdentifyStreams();
+
+	// Gives every reader a turn without waiting, like calling poll() on each of them. Never call the blocking
+	// functions of a reader held here or poll() it directly. Returns true while any reader is busy.
+	bool poll();
+
+	// Stores a template of size bytes, e.g. one written by captureTemplate(), at page ID of every reader that is not
+	// running an operation. Readers on different ports get the template at the same time, readers sharing a port
+	// take turns, after any reply a busy reader on their port still waits for. Returns how many readers stored it,
+	// getDeployResult() tells how each one did.
+	byte deployTemplate(const byte* data, uint16_t size, uint16_t ID);
+
+	// Enrolls a fingerprint on reader index at page ID and stores it at page ID of every other reader, so the finger is
+	// only placed on one reader. buffer must hold the template, e.g. AS108M_REPOSITORY_SLOT_SIZE bytes.
+	// Returns how many readers, the enrolling one included, stored it.
+	byte enrollTemplate(byte index, uint16_t ID, byte* buffer, uint16_t bufferSize, byte numSamples = 5);
+
+	// Returns how storing the last deployed template went on reader index.
+	AS108M_DEPLOY_RESULT getDeployResult(byte index);
+
+	// Returns the statistics of reader index.
+	AS108M_READER_STATS getStats(byte index);
+
+	// Returns how many packets read from shared ports carried an address no reader uses.
+	uint32_t getUnroutedPackets();
+
+	// Clears the statistics of every reader.
+	void resetStats();
+
+	// Sets an optional function that is called with the reader index and outcome when an operation ends.
+	void setCallback(void(*callBack)(byte index, AS108M_ASYNC_STATUS status));
+};
+#endif
@@ -0,0 +1,458 @@
+/*
+  This is a library written for the AS108M Capacitive Fingerprint Scanner
+  SparkFun sells these at its website:
+https://www.sparkfun.com/products/17151
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  Written by Ricardo Ramos  @ SparkFun Electronics, April 14th, 2021
+  This file implements the host-side template repository that keeps readers in sync.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SparkFun_AS108M_Repository.h"
+
+// Header and directory geometry
+static const byte repositoryMagic[4] = { 'A', 'S', '8', 'R' };
+static const byte repositoryFormatVersion = 1;
+static const byte headerSize = 12;
+static const byte entrySize = 6;
+
+// Slot versions held by each notepad page
+static const byte versionsPerPage = AS108M_NOTEPAD_PAGE_SIZE / 2;
+
+// CRC-16/CCITT, so a template that got corrupted in storage is never sent to a reader
+static uint16_t updateChecksum(uint16_t crc, byte data)
+{
+	crc ^= static_cast<uint16_t>(data) << 8;
+	for (byte i = 0; i < 8; i++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+
+	return crc;
+}
+
+// Reads a template out of storage as a Stream, a chunk at a time, checksumming it on the way
+class AS108M_SLOT_READER : public Stream
+{
+private:
+	AS108M_STORAGE& _storage;
+	uint32_t _offset;
+	uint16_t _left;
+	byte _chunk[16];
+	byte _chunkSize = 0;
+	byte _chunkIndex = 0;
+
+public:
+	uint16_t checksum = 0xffff;
+	bool failed = false;
+
+	AS108M_SLOT_READER(AS108M_STORAGE& storage, uint32_t offset, uint16_t length) : _storage(storage), _offset(offset), _left(length) {}
+
+	int available()
+	{
+		return (_chunkSize - _chunkIndex) + _left;
+	}
+
+	int peek()
+	{
+		if (_chunkIndex == _chunkSize)
+		{
+			if (_left == 0)
+				return -1;
+
+			_chunkSize = (_left > sizeof(_chunk)) ? sizeof(_chunk) : _left;
+			_chunkIndex = 0;
+			if (!_storage.read(_offset, _chunk, _chunkSize))
+			{
+				failed = true;
+				_chunkSize = 0;
+				_left = 0;
+				return -1;
+			}
+
+			_offset += _chunkSize;
+			_left -= _chunkSize;
+		}
+
+		return _chunk[_chunkIndex];
+	}
+
+	int read()
+	{
+		int data = peek();
+		if (data < 0)
+			return data;
+
+		_chunkIndex++;
+		checksum = updateChecksum(checksum, data);
+		return data;
+	}
+
+	size_t write(uint8_t)
+	{
+		return 0;
+	}
+};
+
+// Writes a template into storage as a Print, a chunk at a time, checksumming it on the way
+class AS108M_SLOT_WRITER : public Print
+{
+private:
+	AS108M_STORAGE& _storage;
+	uint32_t _offset;
+	uint16_t _space;
+	byte _chunk[16];
+	byte _chunkSize = 0;
+
+public:
+	uint16_t checksum = 0xffff;
+	uint16_t length = 0;
+	bool failed = false;
+
+	AS108M_SLOT_WRITER(AS108M_STORAGE& storage, uint32_t offset, uint16_t space) : _storage(storage), _offset(offset), _space(space) {}
+
+	using Print::write;
+
+	size_t write(uint8_t data)
+	{
+		// A template too large for the slot is refused as a whole
+		if (failed || length == _space)
+		{
+			failed = true;
+			return 0;
+		}
+
+		_chunk[_chunkSize++] = data;
+		checksum = updateChecksum(checksum, data);
+		length++;
+
+		if (_chunkSize == sizeof(_chunk))
+			flush();
+
+		return 1;
+	}
+
+	void flush()
+	{
+		if (_chunkSize > 0 && !_storage.write(_offset, _chunk, _chunkSize))
+			failed = true;
+
+		_offset += _chunkSize;
+		_chunkSize = 0;
+	}
+};
+
+bool AS108M_REPOSITORY::begin(AS108M_STORAGE& storage)
+{
+	_storage = NULL;
+
+	byte header[headerSize];
+	if (!storage.read(0, header, headerSize))
+		return false;
+
+	if (memcmp(header, repositoryMagic, 4) != 0 || header[4] != repositoryFormatVersion || header[5] == 0)
+		return false;
+
+	_slotCount = header[5];
+	_slotSize = header[6] << 8 | header[7];
+	_id = static_cast<uint32_t>(header[8]) << 24 | static_cast<uint32_t>(header[9]) << 16 | static_cast<uint32_t>(header[10]) << 8 | header[11];
+	_storage = &storage;
+	return true;
+}
+
+bool AS108M_REPOSITORY::format(AS108M_STORAGE& storage, uint32_t id, byte slotCount, uint16_t slotSize)
+{
+	_storage = NULL;
+	if (id == 0 || slotCount == 0)
+		return false;
+
+	// Empty directory first, so a format that is cut short leaves no valid header behind
+	byte entry[entrySize] = { 0 };
+	for (byte slot = 0; slot < slotCount; slot++)
+	{
+		if (!storage.write(headerSize + static_cast<uint32_t>(slot) * entrySize, entry, entrySize))
+			return false;
+	}
+
+	byte header[headerSize] = { repositoryMagic[0], repositoryMagic[1], repositoryMagic[2], repositoryMagic[3], repositoryFormatVersion, slotCount,
+		static_cast<byte>(slotSize >> 8), static_cast<byte>(slotSize & 0xff),
+		static_cast<byte>(id >> 24), static_cast<byte>(id >> 16), static_cast<byte>(id >> 8), static_cast<byte>(id & 0xff) };
+	if (!storage.write(0, header, headerSize))
+		return false;
+
+	return begin(storage);
+}
+
+byte AS108M_REPOSITORY::getSlotCount()
+{
+	return _slotCount;
+}
+
+uint16_t AS108M_REPOSITORY::getSlotSize()
+{
+	return _slotSize;
+}
+
+uint32_t AS108M_REPOSITORY::getId()
+{
+	return _id;
+}
+
+uint32_t AS108M_REPOSITORY::entryOffset(byte slot)
+{
+	return headerSize + static_cast<uint32_t>(slot) * entrySize;
+}
+
+uint32_t AS108M_REPOSITORY::templateOffset(byte slot)
+{
+	return headerSize + static_cast<uint32_t>(_slotCount) * entrySize + static_cast<uint32_t>(slot) * _slotSize;
+}
+
+AS108M_SLOT_INFO AS108M_REPOSITORY::getSlotInfo(byte slot)
+{
+	AS108M_SLOT_INFO info;
+	byte entry[entrySize];
+
+	if (_storage == NULL || slot >= _slotCount || !_storage->read(entryOffset(slot), entry, entrySize))
+		return info;
+
+	info.version = entry[0] << 8 | entry[1];
+	info.length = entry[2] << 8 | entry[3];
+	info.checksum = entry[4] << 8 | entry[5];
+	return info;
+}
+
+bool AS108M_REPOSITORY::writeSlotInfo(byte slot, const AS108M_SLOT_INFO& info)
+{
+	const byte entry[entrySize] = { static_cast<byte>(info.version >> 8), static_cast<byte>(info.version & 0xff),
+		static_cast<byte>(info.length >> 8), static_cast<byte>(info.length & 0xff),
+		static_cast<byte>(info.checksum >> 8), static_cast<byte>(info.checksum & 0xff) };
+
+	return _storage->write(entryOffset(slot), entry, entrySize);
+}
+
+bool AS108M_REPOSITORY::clearSlotInfo(byte slot, AS108M_SLOT_INFO& info)
+{
+	info = getSlotInfo(slot);
+	if (info.length == 0)
+		return true;
+
+	info.version++;
+	info.length = 0;
+	info.checksum = 0;
+	return writeSlotInfo(slot, info);
+}
+
+bool AS108M_REPOSITORY::putTemplate(byte slot, Stream& source, uint16_t length)
+{
+	if (_storage == NULL || slot >= _slotCount || length == 0 || length > _slotSize)
+		return false;
+
+	// The slot reads as empty while its template is overwritten, so a write that is cut short never leaves the old
+	// length and checksum over half a template. The final directory entry tells readers there's a new version
+	AS108M_SLOT_INFO info;
+	if (!clearSlotInfo(slot, info))
+		return false;
+
+	AS108M_SLOT_WRITER writer(*_storage, templateOffset(slot), _slotSize);
+	byte chunk[16];
+	for (uint16_t copied = 0; copied < length; )
+	{
+		uint16_t left = length - copied;
+		byte chunkSize = (left > sizeof(chunk)) ? sizeof(chunk) : left;
+		if (source.readBytes(chunk, chunkSize) != chunkSize)
+			return false;
+
+		writer.write(chunk, chunkSize);
+		copied += chunkSize;
+	}
+	writer.flush();
+
+	if (writer.failed)
+		return false;
+
+	info.version++;
+	info.length = length;
+	info.checksum = writer.checksum;
+	return writeSlotInfo(slot, info);
+}
+
+bool AS108M_REPOSITORY::getTemplate(byte slot, Print& sink)
+{
+	AS108M_SLOT_INFO info = getSlotInfo(slot);
+	if (info.length == 0)
+		return false;
+
+	AS108M_SLOT_READER reader(*_storage, templateOffset(slot), info.length);
+	while (reader.available() > 0)
+	{
+		int data = reader.read();
+		if (data < 0)
+			return false;
+
+		sink.write(static_cast<byte>(data));
+	}
+
+	return !reader.failed && reader.checksum == info.checksum;
+}
+
+bool AS108M_REPOSITORY::removeTemplate(byte slot)
+{
+	if (_storage == NULL || slot >= _slotCount)
+		return false;
+
+	AS108M_SLOT_INFO info;
+	return clearSlotInfo(slot, info);
+}
+
+bool AS108M_REPOSITORY::importTemplate(AS108M& reader, byte slot)
+{
+	if (_storage == NULL || slot >= _slotCount)
+		return false;
+
+	if (!reader.loadTemplate(slot, AS108M_BUFFER_ID_1))
+		return false;
+
+	// Upload straight into the slot, the template is never held in RAM
+	AS108M_SLOT_INFO info;
+	if (!clearSlotInfo(slot, info))
+		return false;
+
+	AS108M_SLOT_WRITER writer(*_storage, templateOffset(slot), _slotSize);
+	bool success = reader.uploadTemplate(writer, AS108M_BUFFER_ID_1);
+	writer.flush();
+
+	if (!success || writer.failed || writer.length == 0)
+		return false;
+
+	info.version++;
+	info.length = writer.length;
+	info.checksum = writer.checksum;
+	return writeSlotInfo(slot, info);
+}
+
+bool AS108M_REPOSITORY::syncSlot(AS108M& reader, byte slot, const AS108M_SLOT_INFO& info)
+{
+	if (info.length == 0)
+	{
+		// Nothing to delete, the reader only needs to note the version
+		if (!reader.isSlotUsed(slot))
+			return true;
+
+		if (!reader.deleteFingerprintEntry(slot))
+			return false;
+
+		_syncStats.deleted++;
+		return true;
+	}
+
+	// The template is checked while it is sent and only stored if it was sent as it was put in
+	AS108M_SLOT_READER source(*_storage, templateOffset(slot), info.length);
+	if (!reader.downloadTemplate(source, info.length, AS108M_BUFFER_ID_1) || source.failed || source.checksum != info.checksum)
+		return false;
+
+	if (!reader.storeTemplate(slot, AS108M_BUFFER_ID_1))
+		return false;
+
+	_syncStats.transferred++;
+	_syncStats.bytes += info.length;
+	return true;
+}
+
+bool AS108M_REPOSITORY::syncReader(AS108M& reader, byte notepadPage)
+{
+	uint32_t start = millis();
+	_syncStats = AS108M_SYNC_STATS();
+
+	byte versionPages = (_slotCount + versionsPerPage - 1) / versionsPerPage;
+	if (_storage == NULL || notepadPage + 1 + versionPages > AS108M_NOTEPAD_PAGES)
+		return false;
+
+	// Which slots the reader holds, and how many it can hold
+	uint16_t databaseSize = reader.getDatabaseSize();
+	if (databaseSize == 0 || !reader.readIndexTable(true))
+		return false;
+
+	// Versions are only meaningful if the reader was last synced from this very repository
+	byte page[AS108M_NOTEPAD_PAGE_SIZE];
+	if (!reader.readNotepad(notepadPage, page))
+		return false;
+
+	const byte id[8] = { repositoryMagic[0], repositoryMagic[1], repositoryMagic[2], repositoryMagic[3],
+		static_cast<byte>(_id >> 24), static_cast<byte>(_id >> 16), static_cast<byte>(_id >> 8), static_cast<byte>(_id & 0xff) };
+	bool known = memcmp(page, id, sizeof(id)) == 0;
+
+	for (byte versionPage = 0; versionPage < versionPages; versionPage++)
+	{
+		if (known)
+		{
+			if (!reader.readNotepad(notepadPage + 1 + versionPage, page))
+				return false;
+		}
+		else
+			memset(page, 0, sizeof(page));
+
+		bool dirty = !known;
+		for (byte i = 0; i < versionsPerPage; i++)
+		{
+			uint16_t slot = versionPage * versionsPerPage + i;
+			if (slot >= _slotCount)
+				break;
+
+			AS108M_SLOT_INFO info = getSlotInfo(slot);
+			uint16_t version = page[2 * i] << 8 | page[2 * i + 1];
+			_syncStats.checked++;
+
+			// A slot beyond the reader's database can only be in sync if it's empty
+			if (slot >= databaseSize)
+			{
+				if (info.length > 0)
+					_syncStats.failed++;
+				continue;
+			}
+
+			if (version == info.version && (info.length > 0) == reader.isSlotUsed(slot))
+			{
+				_syncStats.unchanged++;
+				continue;
+			}
+
+			// A failed slot keeps its old version so the next sync tries it again
+			if (!syncSlot(reader, slot, info))
+			{
+				_syncStats.failed++;
+				continue;
+			}
+
+			page[2 * i] = info.version >> 8;
+			page[2 * i + 1] = info.version & 0xff;
+			dirty = true;
+		}
+
+		if (dirty && !reader.writeNotepad(notepadPage + 1 + versionPage, page))
+			return false;
+	}
+
+	// The repository ID goes in last, so a sync that is cut short is done from scratch again
+	if (!known)
+	{
+		memset(page, 0, sizeof(page));
+		memcpy(page, id, sizeof(id));
+		if (!reader.writeNotepad(notepadPage, page))
+			return false;
+	}
+
+	_syncStats.elapsed = millis() - start;
+	return _syncStats.failed == 0;
+}
+
+AS108M_SYNC_STATS AS108M_REPOSITORY::getSyncStats()
+{
+	return _syncStats;
+}
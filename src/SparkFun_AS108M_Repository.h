@@ -0,0 +1,139 @@
+/*
+  This is a library written for the AS108M Capacitive Fingerprint Scanner
+  SparkFun sells these at its website:
+https://www.sparkfun.com/products/17151
+
+  Do you like this library? Help support open source hardware. Buy a board!
+
+  Written by Ricardo Ramos  @ SparkFun Electronics, April 14th, 2021
+  This file declares the host-side template repository that keeps readers in sync.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SparkFun_AS108M_Repository__
+#define __SparkFun_AS108M_Repository__
+#include "SparkFun_AS108M_Constants.h"
+#include "SparkFun_AS108M_Arduino_Library.h"
+#include <Arduino.h>
+
+// Whatever holds the repository: a file on an SD card, an EEPROM, a flash partition...
+// Implement both functions over it and hand it to AS108M_REPOSITORY.
+class AS108M_STORAGE
+{
+public:
+	// Reads size bytes at offset into data. Returns false if they could not be read.
+	virtual bool read(uint32_t offset, byte* data, uint16_t size) = 0;
+
+	// Writes size bytes from data at offset. Returns false if they could not be written.
+	virtual bool write(uint32_t offset, const byte* data, uint16_t size) = 0;
+};
+
+// Struct that holds what the repository knows about one slot
+struct AS108M_SLOT_INFO
+{
+	// Bumped every time the slot is written or cleared, 0 if it never was
+	uint16_t version = 0;
+	// Template size in bytes, 0 if the slot is empty
+	uint16_t length = 0;
+	// CRC-16 of the template
+	uint16_t checksum = 0;
+};
+
+// Struct that holds the outcome of the last reader sync
+struct AS108M_SYNC_STATS
+{
+	// Slots compared, slots already up to date, templates sent, templates deleted and slots that could not be synced
+	uint16_t checked = 0;
+	uint16_t unchanged = 0;
+	uint16_t transferred = 0;
+	uint16_t deleted = 0;
+	uint16_t failed = 0;
+	// Template bytes sent
+	uint32_t bytes = 0;
+	// Sync time in msec
+	uint32_t elapsed = 0;
+};
+
+// Repository layout in storage, all values MSB first:
+//  - header: "AS8R", format version, slot count, slot size (2 bytes) and repository ID (4 bytes)
+//  - directory: version, length and checksum of every slot (2 bytes each)
+//  - templates: one slot size long area per slot
+// Readers remember which version of each slot they hold in their notepad, from notepadPage on:
+//  - first page: "AS8R" and the ID of the repository the reader was synced from
+//  - next pages: slot versions, 16 slots per page
+class AS108M_REPOSITORY
+{
+private:
+	// Storage holding the repository, NULL until begin() or format() succeeded.
+	AS108M_STORAGE* _storage = NULL;
+
+	// Repository geometry and identity, as read from the header.
+	byte _slotCount = 0;
+	uint16_t _slotSize = 0;
+	uint32_t _id = 0;
+
+	// Outcome of the last reader sync.
+	AS108M_SYNC_STATS _syncStats;
+
+	// Where a slot's directory entry and template live in storage.
+	uint32_t entryOffset(byte slot);
+	uint32_t templateOffset(byte slot);
+
+	// Writes a slot's directory entry.
+	bool writeSlotInfo(byte slot, const AS108M_SLOT_INFO& info);
+
+	// Empties a slot's directory entry, bumping its version unless it was empty already. info is set to the entry.
+	bool clearSlotInfo(byte slot, AS108M_SLOT_INFO& info);
+
+	// Sends the template in slot to reader, or deletes it from reader if the slot is empty.
+	bool syncSlot(AS108M& reader, byte slot, const AS108M_SLOT_INFO& info);
+
+public:
+	// Opens the repository held in storage. Returns false if storage does not hold one.
+	bool begin(AS108M_STORAGE& storage);
+
+	// Creates an empty repository of slotCount slots, each up to slotSize bytes long, in storage.
+	// Any repository held there before is lost and every reader synced from it will be synced from scratch.
+	// id tells the repository apart from any other a reader may have been synced from, so it must not be 0 and should
+	// come from a true random source, e.g. esp_random() on an ESP32, or from a counter that never repeats.
+	bool format(AS108M_STORAGE& storage, uint32_t id, byte slotCount = 40, uint16_t slotSize = AS108M_REPOSITORY_SLOT_SIZE);
+
+	// Returns the number of slots, their size in bytes and the ID telling this repository apart from others.
+	byte getSlotCount();
+	uint16_t getSlotSize();
+	uint32_t getId();
+
+	// Returns the version, length and checksum of a slot. An unreadable slot reads as empty.
+	AS108M_SLOT_INFO getSlotInfo(byte slot);
+
+	// Stores a template of length bytes read from source into slot. The slot is emptied first, so it stays empty
+	// if the template can't be stored.
+	bool putTemplate(byte slot, Stream& source, uint16_t length);
+
+	// Writes the template held in slot to sink. Returns false if the slot is empty or the template fails its checksum,
+	// in which case discard what was written.
+	bool getTemplate(byte slot, Print& sink);
+
+	// Empties slot.
+	bool removeTemplate(byte slot);
+
+	// Copies the template stored at page slot of reader into slot, e.g. right after enrolling it there.
+	// Like putTemplate(), the slot stays empty if the template can't be stored.
+	bool importTemplate(AS108M& reader, byte slot);
+
+	// Brings reader's database in line with the repository. Only the slots whose version differs from the one the reader
+	// last got, or whose occupancy differs from the repository, are sent or deleted, so a reader that is up to date costs
+	// one index table read and a few notepad reads. A reader synced from another repository is synced from scratch.
+	// The notepad pages from notepadPage on are used to keep track of the slot versions. Returns false if any slot failed.
+	bool syncReader(AS108M& reader, byte notepadPage = AS108M_REPOSITORY_NOTEPAD_PAGE);
+
+	// Returns what the last syncReader() did.
+	AS108M_SYNC_STATS getSyncStats();
+};
+#endif